@@ -0,0 +1,96 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define ARENA_MMAP
+#endif
+
+#define ARENA_HUGE_PAGE (2 << 20) // size of a transparent huge page on x86-64 and AArch64
+
+size_t _align_up(const size_t n, const size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+size_t Arena_Reserve(const size_t capacity, const size_t size, const size_t align)
+{
+    return capacity + size + align - 1; // the worst padding, whatever the order of the blocks
+}
+
+Arena* Arena_Create(const size_t capacity, const uint8_t flags)
+{
+    /* The header takes the first page, so that the blocks start page aligned */
+
+    const size_t size = ARENA_PAGE + _align_up(capacity, ARENA_PAGE);
+
+#ifdef ARENA_MMAP
+
+    // with huge pages the arena starts on a huge page boundary, the system can only back aligned ranges with them
+    const size_t align = flags & ARENA_HUGE_PAGES ? ARENA_HUGE_PAGE : ARENA_PAGE;
+    const size_t mapping_size = size + align - ARENA_PAGE;
+
+    void* mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "ERROR of Arena_Create: Unable to reserve %zu bytes.\n", mapping_size);
+        return NULL;
+    }
+
+    uint8_t* start = (uint8_t*)_align_up((uintptr_t)mapping, align);
+
+#ifdef MADV_HUGEPAGE
+    if (flags & ARENA_HUGE_PAGES) madvise(start, size, MADV_HUGEPAGE); // only a hint, ignored if huge pages are disabled
+#endif
+
+#else
+
+    const size_t mapping_size = size + ARENA_PAGE;
+    void* mapping = calloc(1, mapping_size); // no lazy mapping to rely on, the system allocator does what it can
+
+    if (!mapping) {
+        fprintf(stderr, "ERROR of Arena_Create: Unable to reserve %zu bytes.\n", mapping_size);
+        return NULL;
+    }
+
+    uint8_t* start = (uint8_t*)_align_up((uintptr_t)mapping, ARENA_PAGE);
+
+#endif
+
+    Arena* arena = (Arena*)start;
+
+    arena->base = start + ARENA_PAGE;
+    arena->capacity = size - ARENA_PAGE;
+    arena->used = 0;
+    arena->mapping = mapping;
+    arena->mapping_size = mapping_size;
+    arena->flags = flags;
+
+    return arena;
+}
+
+void* Arena_Alloc(Arena* arena, const size_t size, const size_t align)
+{
+    const size_t offset = _align_up(arena->used, align); // the base is page aligned
+
+    if (offset + size > arena->capacity) {
+        fprintf(stderr, "ERROR of Arena_Alloc: %zu bytes requested, %zu left in the arena.\n", size, arena->capacity - arena->used);
+        return NULL;
+    }
+
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+void Arena_Destroy(Arena* arena)
+{
+    void* mapping = arena->mapping; // the header is released with the blocks
+
+#ifdef ARENA_MMAP
+    munmap(mapping, arena->mapping_size);
+#else
+    free(mapping);
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_LINE              64          // default alignment of the blocks, a cache line
+#define ARENA_PAGE              4096        // alignment of the big blocks (framebuffers), so they start on their own pages
+
+#define ARENA_HUGE_PAGES        0x01        // asks the system to back the arena with huge pages (Linux transparent huge pages)
+
+// An arena reserves its whole capacity at creation and hands out aligned blocks one after the other.
+// The blocks are zeroed and never freed one by one, Arena_Destroy releases all of them at once.
+// The memory is mapped lazily by the system: the pages of a block never touched cost nothing.
+
+typedef struct {
+    uint8_t* base;              // first byte usable for the blocks
+    size_t capacity, used;
+    void* mapping;              // what was reserved, released by Arena_Destroy
+    size_t mapping_size;
+    uint8_t flags;
+} Arena;
+
+size_t Arena_Reserve( // capacity needed to add a block of size bytes to an arena of capacity bytes, for the callers computing their layout
+    const size_t capacity,
+    const size_t size,
+    const size_t align
+);
+
+Arena* Arena_Create( // the arena header lives in its own memory, NULL if the memory can't be reserved
+    const size_t capacity,
+    const uint8_t flags
+);
+
+void* Arena_Alloc( // align is a power of two up to ARENA_PAGE, NULL if the arena is full
+    Arena* arena,
+    const size_t size,
+    const size_t align
+);
+
+void Arena_Destroy(
+    Arena* arena
+);
+
+#endif
@@ -0,0 +1,620 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "window.h"
+#include "clock.h"
+#include "map.h"
+#include "light.h"
+#include "palette.h"
+#include "raycast.h"
+
+/* Benchmark of the textured mode at high resolutions: make bench [BENCH_FRAMES=n], make profiles compares the builds
+   Raycaster-bench [frames] [--headless] [--capture prefix]: --headless renders without a window (SDL dummy video
+   driver), --capture records the copy runs to prefix-<resolution>.y4m, the frames the writer can't keep up with are dropped.
+   Each resolution runs the copy, zero-copy and pipelined paths (also with a sync each frame), the score only counts the first two.
+   Raycaster-bench --batch [poses] renders batches of BATCH_W x BATCH_H observations with 1, 2, 4... workers up to the
+   CPU count and prints the observations per second of each.
+
+   Golden images: Raycaster-bench --verify [dir] [--update] [--tolerance n] renders fixed maps from fixed poses (edge
+   cases included: against a wall, extreme pitch, jumping) in each mode, without a window, with every kernel set the
+   CPU supports. The frames of each set must match the scalar ones, and with dir the scalar frames must match the
+   references stored there as dir/<map>-<mode>-<pose>.png, written by --update. Scenes built for what the batch modes
+   don't show (low walls, sprites, materials) and for the paths of Raycast_Render (interlace, zero-copy) go through
+   Raycast_Render, as dir/scene-<name>.png. A channel may differ by tolerance (0 by default), the frames failing are
+   saved next to the references as <name>.<set>.png. Returns 1 if a frame doesn't match. make check verifies golden/. */
+
+#define BENCH_FRAMES 120
+
+#define GOLDEN_W 320
+#define GOLDEN_H 200
+#define GOLDEN_POSES 8
+#define GOLDEN_SCENES 6
+
+#define BATCH_W 84          // first-person observations of simulated agents
+#define BATCH_H 84
+#define BATCH_POSES 1024
+#define BATCH_RUNS 10
+
+typedef struct {
+    const char* name;
+    uint16_t w, h;
+} Bench_Res;
+
+double _bench_frames(Raycast_Data* raycast, SDL_Renderer* renderer, const Clock* clock, const unsigned frames, const SDL_bool sync) // average ms per frame
+{
+    // sync waits for the frame in flight before each one, like a game editing its map or sprites every tick
+
+    const float rot = .01f; // the camera turns a little each frame so that the frames differ
+
+    uint64_t total = 0;
+
+    for (unsigned i = 0; i < frames; i++)
+    {
+        const float old_dir_x = raycast->dir_x, old_plane_x = raycast->plane_x;
+        raycast->dir_x = raycast->dir_x * cosf(rot) - raycast->dir_y * sinf(rot);
+        raycast->dir_y = old_dir_x * sinf(rot) + raycast->dir_y * cosf(rot);
+        raycast->plane_x = raycast->plane_x * cosf(rot) - raycast->plane_y * sinf(rot);
+        raycast->plane_y = old_plane_x * sinf(rot) + raycast->plane_y * cosf(rot);
+
+        const uint64_t start = SDL_GetPerformanceCounter();
+
+        if (sync) Raycast_SyncPipeline(raycast);
+        Raycast_Render(raycast, renderer, clock);
+        SDL_RenderPresent(renderer);
+
+        total += SDL_GetPerformanceCounter() - start;
+    }
+
+    return total * 1000. / SDL_GetPerformanceFrequency() / frames;
+}
+
+/* GOLDEN IMAGES functions */
+
+typedef struct {
+    const char* dir;            // NULL only compares the kernel sets with each other
+    SDL_bool update;
+    uint8_t tolerance;
+    unsigned checked, failed;
+} Golden_Run;
+
+Raycast_Pose _golden_pose(const float x, const float y, const float angle, const float pos_z, const float pitch)
+{
+    const float dir_x = cosf(angle), dir_y = sinf(angle);
+    return (Raycast_Pose){ x, y, pos_z, pitch, dir_x, dir_y, dir_y * .66f, -dir_x * .66f };
+}
+
+void _golden_poses(const Map* map, Raycast_Pose* poses, const char** names)
+{
+    /* The free cell nearest to the center of the map, and the first one with a wall on its east side */
+
+    int cx = 1, cy = 1, best = -1, wx = 1, wy = 1;
+
+    for (int x = 1; x < map->width - 1; x++) for (int y = 1; y < map->height - 1; y++)
+    {
+        if (map->data[x][y]) continue;
+
+        const int d = abs(x - map->width / 2) + abs(y - map->height / 2);
+        if (best < 0 || d < best) best = d, cx = x, cy = y;
+        if (map->data[x+1][y] && wx == 1 && wy == 1) wx = x, wy = y;
+    }
+
+    const char* pose_names[GOLDEN_POSES] = {
+        "east", "diagonal", "west", "pitch-up", "pitch-down", "jump", "wall", "wall-pitch"
+    };
+
+    poses[0] = _golden_pose(cx + .5f, cy + .5f, 0.f, 0.f, 0.f);
+    poses[1] = _golden_pose(cx + .5f, cy + .5f, .7f, 0.f, 0.f);                   // the rays go in both directions on each axis
+    poses[2] = _golden_pose(cx + .5f, cy + .5f, 3.34f, 0.f, 0.f);
+    poses[3] = _golden_pose(cx + .5f, cy + .5f, 2.f, 0.f, GOLDEN_H);              // the horizon out of the frame
+    poses[4] = _golden_pose(cx + .5f, cy + .5f, 4.f, 0.f, -GOLDEN_H);
+    poses[5] = _golden_pose(cx + .5f, cy + .5f, 5.f, GOLDEN_H / 3.f, GOLDEN_H / 4.f);
+    poses[6] = _golden_pose(wx + .99f, wy + .5f, 0.f, 0.f, 0.f);                  // the wall much higher than the frame
+    poses[7] = _golden_pose(wx + .99f, wy + .5f, .3f, -GOLDEN_H / 3.f, -GOLDEN_H);
+
+    for (int i = 0; i < GOLDEN_POSES; i++) names[i] = pose_names[i];
+}
+
+TexGroup* _golden_tex_group(const int length, const uint16_t size) // hashed, every texel differs
+{
+    TexGroup* group = malloc(sizeof(TexGroup));
+    group->length = length;
+    group->w = group->h = size;
+    group->indices = NULL;
+    group->palette_id = 0;
+    SDL_AtomicSet(&group->refs, 1);
+    group->pixels = malloc(length * sizeof(Pixel*));
+
+    for (int i = 0; i < length; i++) {
+        group->pixels[i] = malloc(sizeof(Pixel) * size * size);
+        for (int j = 0; j < size * size; j++) group->pixels[i][j] = ((j + i * 97) * 2246822519u) >> 8;
+    }
+
+    return group;
+}
+
+void _golden_mode(Raycast_Data* raycast, const char* mode, const Lightmap* lightmap)
+{
+    if (!strcmp(mode, "lit")) Raycast_LoadLightmap(raycast, lightmap);
+    else if (!strcmp(mode, "palette")) Raycast_LoadPalette(raycast, Palette_Default(), 8.f);
+    else if (!strcmp(mode, "sizes")) // the kernels for 128 and for any other size, the others run with 64
+    {
+        const uint16_t sizes[2] = { 128, 32 };
+        Texture* tex[2];
+
+        for (int i = 0; i < 2; i++) {
+            tex[i] = malloc(sizeof(Texture));
+            tex[i]->w = tex[i]->h = sizes[i];
+            tex[i]->indices = NULL;
+            tex[i]->palette_id = 0;
+            SDL_AtomicSet(&tex[i]->refs, 1);
+            tex[i]->pixels = malloc(sizeof(Pixel) * sizes[i] * sizes[i]);
+            for (int j = 0; j < sizes[i] * sizes[i]; j++) tex[i]->pixels[j] = (j * 2654435761u) >> 8; // hashed, every texel differs
+        }
+
+        Raycast_LoadTex(NULL, raycast, tex[0], Texture_Retain(tex[1]), _golden_tex_group(raycast->map->wall_num, 32));
+        Texture_Free(tex[1]);
+    }
+}
+
+SDL_bool _golden_file(const char* path, uint32_t* frame, const SDL_bool write) // PNG without alpha, the frames are opaque
+{
+    if (write) {
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(frame, GOLDEN_W, GOLDEN_H, 32, GOLDEN_W * sizeof(uint32_t), SDL_PIXELFORMAT_RGB888);
+        const SDL_bool ok = surface && !IMG_SavePNG(surface, path);
+        SDL_FreeSurface(surface);
+        return ok;
+    }
+
+    SDL_Surface* image = IMG_Load(path);
+    if (!image) return SDL_FALSE;
+
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(image);
+
+    const SDL_bool ok = surface && surface->w == GOLDEN_W && surface->h == GOLDEN_H;
+
+    if (ok) for (int y = 0; y < GOLDEN_H; y++)
+        memcpy(frame + y * GOLDEN_W, (uint8_t*)surface->pixels + y * surface->pitch, GOLDEN_W * sizeof(uint32_t));
+
+    SDL_FreeSurface(surface);
+    return ok;
+}
+
+void _golden_check(Golden_Run* run, const char* name, const char* set, uint32_t* frame, const uint32_t* reference)
+{
+    uint8_t max_delta = 0;
+    const uint32_t differ = Capture_Compare(frame, reference, GOLDEN_W * GOLDEN_H, run->tolerance, &max_delta);
+
+    run->checked++;
+    if (!differ) return;
+
+    run->failed++;
+    printf("FAIL %-24s %-7s %u pixels differ, up to %u\n", name, set, differ, max_delta);
+
+    if (run->dir) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.%s.png", run->dir, name, set);
+        _golden_file(path, frame, SDL_TRUE);
+    }
+}
+
+void _golden_compare(Golden_Run* run, const char* name, const char* set, uint32_t* frame, const uint32_t* reference, uint32_t* stored)
+{
+    // the frames of the other sets are compared to the scalar ones, which are compared to the references
+
+    if (strcmp(set, "scalar")) {
+        _golden_check(run, name, set, frame, reference);
+        return;
+    }
+
+    if (!run->dir) return;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.png", run->dir, name);
+
+    if (run->update) {
+        if (_golden_file(path, frame, SDL_TRUE)) return;
+        fprintf(stderr, "ERROR of _golden_compare: Unable to write \"%s\".\n", path);
+        run->failed++;
+    }
+    else if (!_golden_file(path, stored, SDL_FALSE)) {
+        printf("MISSING %s (written by --update)\n", path);
+        run->failed++;
+    }
+    else _golden_check(run, name, "golden", frame, stored);
+}
+
+/* The scenes are maps built for the features the batch doesn't draw, rendered by Raycast_Render like a game frame */
+
+typedef struct {
+    const char* name;
+    Map* map;
+    SpriteSet* sprites;
+    TexGroup* materials;        // NULL without materials
+    uint8_t interlace;          // the frame is cast after one from prev, its history
+    SDL_bool zero_copy;
+    Raycast_Pose prev, pose;
+} Golden_Scene;
+
+void _golden_room(Golden_Scene* s) // a low wall, a pillar and sprites on both sides, seen from above
+{
+    for (int y = 8; y <= 16; y++) Map_SetCell(s->map, 10, y, 3), Map_SetHeight(s->map, 10, y, 60);
+    Map_SetCell(s->map, 14, 11, 4);
+
+    Sprite_Add(s->sprites, 7.5f, 13.5f, 2);
+    Sprite_Add(s->sprites, 12.5f, 12.f, 1);
+    Sprite_Add(s->sprites, 16.5f, 13.5f, 0);
+
+    s->pose = _golden_pose(4.5f, 12.5f, .1f, GOLDEN_H / 6.f, -GOLDEN_H / 8.f);
+}
+
+Golden_Scene _golden_scene(const int scene, const RGB_Array wall_colors)
+{
+    Golden_Scene s;
+    s.map = Map_Create(24, 24, 8, wall_colors, 0);
+    s.materials = NULL;
+    s.interlace = INTERLACE_OFF;
+    s.zero_copy = SDL_FALSE;
+
+    Map_FillRect(s.map, 0, 0, 23, 0, 1), Map_FillRect(s.map, 0, 23, 23, 23, 1);
+    Map_FillRect(s.map, 0, 0, 0, 23, 2), Map_FillRect(s.map, 23, 0, 23, 23, 2);
+
+    s.sprites = Sprite_CreateSet(s.map, 8);
+
+    switch (scene)
+    {
+        case 0: // two rows of low walls, the farther one higher: a sprite behind both is hidden below the top of the higher one
+            s.name = "low-walls";
+            for (int y = 6; y <= 18; y++) {
+                Map_SetCell(s.map, 8, y, 3), Map_SetHeight(s.map, 8, y, 60);
+                Map_SetCell(s.map, 10, y, 4), Map_SetHeight(s.map, 10, y, 120);
+            }
+            Sprite_Add(s.sprites, 9.5f, 11.f, 0);   // between the walls
+            Sprite_Add(s.sprites, 14.5f, 12.5f, 1); // behind both
+            Sprite_Add(s.sprites, 14.5f, 14.f, 2);
+            s.pose = _golden_pose(4.5f, 12.5f, 0.f, GOLDEN_H / 4.f, 0.f);
+            break;
+
+        case 1: // sprites overlapping each other, cut by the frame, half hidden by a pillar, with the camera looking up
+            s.name = "sprites";
+            Map_SetCell(s.map, 12, 10, 3), Map_SetCell(s.map, 12, 14, 4);
+            Sprite_Add(s.sprites, 5.2f, 12.9f, 2);  // nearer than the frame is high
+            Sprite_Add(s.sprites, 10.f, 12.2f, 1);
+            Sprite_Add(s.sprites, 10.5f, 12.8f, 0);
+            Sprite_Add(s.sprites, 13.5f, 11.f, 1);  // its left half behind the pillar
+            Sprite_Add(s.sprites, 16.5f, 12.5f, 2); // behind the others
+            Sprite_Add(s.sprites, 20.5f, 6.5f, 0);
+            Sprite_Add(s.sprites, 20.5f, 18.5f, 0);
+            s.pose = _golden_pose(4.5f, 12.5f, 0.f, 0.f, GOLDEN_H / 6.f);
+            break;
+
+        case 2: // floor and ceiling materials changing from cell to cell, next to the textures of the raycaster
+            s.name = "materials";
+            s.materials = _golden_tex_group(2, 64);
+            for (int x = 1; x < 23; x++) for (int y = 1; y < 23; y++) Map_SetMaterial(s.map, x, y, (x + y) % 3, (x * y) % 3);
+            s.pose = _golden_pose(3.5f, 4.5f, .6f, GOLDEN_H / 5.f, -GOLDEN_H / 8.f);
+            break;
+
+        case 3: // the skipped columns reprojected after a step forward and aside, the eye higher and the camera turning
+            s.name = "interlace-columns";
+            _golden_room(&s);
+            s.interlace = INTERLACE_COLUMNS;
+            s.prev = _golden_pose(4.1f, 12.8f, .04f, GOLDEN_H / 5.f, -GOLDEN_H / 8.f);
+            break;
+
+        case 4: // the skipped pixels reprojected after a rotation only, by whole columns
+            s.name = "interlace-checkerboard";
+            _golden_room(&s);
+            s.interlace = INTERLACE_CHECKERBOARD;
+            s.prev = _golden_pose(4.5f, 12.5f, .04f, GOLDEN_H / 6.f, -GOLDEN_H / 6.f);
+            break;
+
+        case 5: // cast in the locked render texture
+            s.name = "zero-copy";
+            _golden_room(&s);
+            s.zero_copy = SDL_TRUE;
+            break;
+    }
+
+    Sprite_Commit(s.sprites);
+    return s;
+}
+
+void _golden_place(Raycast_Data* raycast, const Raycast_Pose* pose)
+{
+    raycast->pos_x = pose->pos_x, raycast->pos_y = pose->pos_y;
+    raycast->pos_z = pose->pos_z, raycast->pitch = pose->pitch;
+    raycast->dir_x = pose->dir_x, raycast->dir_y = pose->dir_y;
+    raycast->plane_x = pose->plane_x, raycast->plane_y = pose->plane_y;
+}
+
+void _golden_render(const Golden_Scene* scene, const char* set, uint32_t* frame) // the frame read back from a software renderer
+{
+    SDL_setenv("RAYCAST_KERNEL", set, 1);
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, GOLDEN_W, GOLDEN_H, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = SDL_CreateSoftwareRenderer(surface);
+
+    Raycast_Data* raycast = Raycast_Init(renderer, GOLDEN_W, GOLDEN_H, scene->map, 0, 0, AUTO_FULL_TEX);
+    Raycast_LoadSprites(raycast, scene->sprites, NULL);
+    if (scene->materials) Raycast_LoadMaterials(raycast, TexGroup_Retain(scene->materials));
+    Raycast_SetZeroCopy(raycast, scene->zero_copy);
+
+    Clock clock = Clock_Init();
+    clock.alpha = 1.f; // no interpolation with the previous pose
+
+    if (scene->interlace) {
+        Raycast_SetInterlace(raycast, scene->interlace);
+        _golden_place(raycast, &scene->prev);
+        Raycast_Render(raycast, renderer, &clock);
+    }
+
+    _golden_place(raycast, &scene->pose);
+    Raycast_Render(raycast, renderer, &clock);
+
+    for (int y = 0; y < GOLDEN_H; y++)
+        memcpy(frame + y * GOLDEN_W, (uint8_t*)surface->pixels + y * surface->pitch, GOLDEN_W * sizeof(uint32_t));
+
+    Raycast_Free(raycast);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+}
+
+int _golden_verify(Golden_Run* run)
+{
+    const char* sets[] = { "scalar", "sse4.1", "avx2", "neon" }; // the scalar frames first, the others are compared to them
+    const char* modes[] = { "tex", "lit", "sizes", "palette" };
+    const char* map_names[] = { "caves", "maze" };
+
+    RGB_Array wall_colors = {
+        { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0},
+        { 255, 0, 255}, { 0, 255, 255}, { 127, 255, 255}, { 255, 127, 255 },
+    };
+
+    const size_t frame_size = GOLDEN_W * GOLDEN_H;
+    uint32_t* frames = malloc((2 * GOLDEN_POSES + 1) * frame_size * sizeof(uint32_t));
+    uint32_t* reference = frames + GOLDEN_POSES * frame_size; // the frames of the scalar kernels
+    uint32_t* stored = reference + GOLDEN_POSES * frame_size;
+
+    for (int m = 0; m < 2; m++)
+    {
+        Map* map = m ? Map_MazeGen(31, 31, 8, wall_colors, 7) : Map_RandGen(32, 32, 8, wall_colors, 1);
+
+        Raycast_Pose poses[GOLDEN_POSES];
+        const char* pose_names[GOLDEN_POSES];
+        _golden_poses(map, poses, pose_names);
+
+        Lightmap* lightmap = Lightmap_Create(map, .3f, 2);
+        Lightmap_AddLight(lightmap, poses[0].pos_x, poses[0].pos_y, 6.f, .9f);
+        Lightmap_AddLight(lightmap, poses[6].pos_x - .5f, poses[6].pos_y, 3.f, .7f);
+
+        for (unsigned mode = 0; mode < sizeof(modes) / sizeof(*modes); mode++)
+        {
+            for (unsigned s = 0; s < sizeof(sets) / sizeof(*sets); s++)
+            {
+                if (!Kernels_Find(sets[s])) continue; // not built or not supported by the CPU
+
+                SDL_setenv("RAYCAST_KERNEL", sets[s], 1); // read by Raycast_Init
+                const uint8_t flags = strcmp(modes[mode], "sizes") ? AUTO_FULL_TEX : 0; // else the textures come from _golden_mode
+                Raycast_Data* raycast = Raycast_Init(NULL, GOLDEN_W, GOLDEN_H, map, 0, 0, flags);
+                if (!raycast) return -1;
+
+                uint32_t* targets[GOLDEN_POSES];
+                for (int i = 0; i < GOLDEN_POSES; i++) targets[i] = (s ? frames : reference) + i * frame_size;
+
+                _golden_mode(raycast, modes[mode], lightmap);
+                Raycast_RenderBatch(raycast, poses, targets, GOLDEN_POSES, GOLDEN_W, GOLDEN_H);
+                Raycast_Free(raycast);
+
+                for (int i = 0; i < GOLDEN_POSES; i++)
+                {
+                    char name[128];
+                    snprintf(name, sizeof(name), "%s-%s-%s", map_names[m], modes[mode], pose_names[i]);
+                    _golden_compare(run, name, sets[s], targets[i], reference + i * frame_size, stored);
+                }
+            }
+        }
+
+        Lightmap_Destroy(lightmap);
+        Map_Destroy(map);
+    }
+
+    for (int i = 0; i < GOLDEN_SCENES; i++)
+    {
+        Golden_Scene scene = _golden_scene(i, wall_colors);
+
+        for (unsigned s = 0; s < sizeof(sets) / sizeof(*sets); s++)
+        {
+            if (!Kernels_Find(sets[s])) continue;
+
+            char name[128];
+            snprintf(name, sizeof(name), "scene-%s", scene.name);
+
+            _golden_render(&scene, sets[s], s ? frames : reference);
+            _golden_compare(run, name, sets[s], s ? frames : reference, reference, stored);
+        }
+
+        if (scene.materials) TexGroup_Destroy(scene.materials);
+        Sprite_DestroySet(scene.sprites);
+        Map_Destroy(scene.map);
+    }
+
+    free(frames);
+
+    printf("%u frames checked (sets:", run->checked);
+    for (unsigned s = 0; s < sizeof(sets) / sizeof(*sets); s++) if (Kernels_Find(sets[s])) printf(" %s", sets[s]);
+    printf("), %u failed%s\n", run->failed, run->dir ? "" : ", no references compared");
+
+    return run->failed ? 1 : 0;
+}
+
+/* BATCH functions */
+
+int _batch_bench(const unsigned count) // observations per second at BATCH_W x BATCH_H against the number of workers
+{
+    RGB_Array wall_colors = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0} };
+
+    Map* map = Map_RandGen(64, 64, 4, wall_colors, 1);
+    Raycast_Data* raycast = Raycast_Init(NULL, BATCH_W, BATCH_H, map, 0, 0, AUTO_FULL_TEX);
+    if (!raycast) return -1;
+
+    /* The poses are spread over the free cells, in every direction */
+
+    Raycast_Pose* poses = malloc(count * sizeof(Raycast_Pose));
+    uint32_t** framebuffers = malloc(count * sizeof(uint32_t*));
+    uint32_t* pixels = malloc((size_t)count * BATCH_W * BATCH_H * sizeof(uint32_t));
+
+    for (unsigned i = 0, cell = 0; i < count; i++, cell += 7)
+    {
+        int x, y;
+        do cell = (cell + 1) % (64 * 64), x = cell % 64, y = cell / 64; while (map->data[x][y]);
+
+        poses[i] = _golden_pose(x + .5f, y + .5f, i * 2.39996f, 0.f, 0.f);
+        framebuffers[i] = pixels + (size_t)i * BATCH_W * BATCH_H;
+    }
+
+    printf("%u observations of %ux%u per batch\n", count, BATCH_W, BATCH_H);
+
+    const unsigned cpus = SDL_GetCPUCount();
+    double single = 0.;
+
+    for (unsigned threads = 1; ; threads = threads * 2 < cpus ? threads * 2 : cpus)
+    {
+        Raycast_SetBatchThreads(raycast, threads);
+        Raycast_RenderBatch(raycast, poses, framebuffers, count, BATCH_W, BATCH_H); // starts the workers
+
+        const uint64_t start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < BATCH_RUNS; i++) Raycast_RenderBatch(raycast, poses, framebuffers, count, BATCH_W, BATCH_H);
+        const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+        const double obs = (double)count * BATCH_RUNS / seconds;
+        if (threads == 1) single = obs;
+
+        printf("%3u threads: %10.0f obs/s (x%.2f)\n", threads, obs, obs / single);
+        if (threads >= cpus) break;
+    }
+
+    free(pixels);
+    free(framebuffers);
+    free(poses);
+    Raycast_Free(raycast);
+    Map_Destroy(map);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned frames = BENCH_FRAMES;
+    const char* capture_prefix = NULL;
+    Golden_Run golden = { NULL, SDL_FALSE, 0, 0, 0 };
+    SDL_bool verify = SDL_FALSE;
+    unsigned batch = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc) capture_prefix = argv[++i];
+        else if (!strcmp(argv[i], "--verify")) {
+            verify = SDL_TRUE;
+            if (i + 1 < argc && strncmp(argv[i+1], "--", 2)) golden.dir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--batch")) batch = i + 1 < argc && strncmp(argv[i+1], "--", 2) ? (unsigned)atoi(argv[++i]) : BATCH_POSES;
+        else if (!strcmp(argv[i], "--update")) golden.update = SDL_TRUE;
+        else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) golden.tolerance = (uint8_t)atoi(argv[++i]);
+        else frames = (unsigned)atoi(argv[i]);
+    }
+
+    if (verify)
+        return _golden_verify(&golden);
+
+    if (batch)
+        return _batch_bench(batch);
+
+    const Bench_Res resolutions[] = {
+        { "1080p", 1920, 1080 },
+        { "4K", 3840, 2160 }
+    };
+
+    RGB_Array wall_colors = {
+        { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0},
+        { 255, 0, 255}, { 0, 255, 255}, { 127, 255, 255}, { 255, 127, 255 },
+    };
+
+    Map* map = Map_RandGen(32, 32, 8, wall_colors, 1); // the same map for every run
+
+    Clock clock = Clock_Init();
+
+    double total_ms = 0.;
+
+    printf("%u frames per mode, %s kernels (RAYCAST_KERNEL=scalar|sse4.1|avx2|neon to compare)\n", frames, Kernels_Select()->name);
+
+    for (unsigned i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+    {
+        const Bench_Res* res = &resolutions[i];
+
+        SDL_Window* window = NULL;
+        SDL_Renderer* renderer = NULL;
+
+        if (Window_Init(&window, &renderer, "Raycaster - Bench", res->w, res->h) != 0)
+            return -1;
+
+        Raycast_Data* raycast = Raycast_Init(renderer, res->w, res->h, map, 0, 0, AUTO_FULL_TEX);
+        SDL_SetRelativeMouseMode(SDL_FALSE);
+
+        if (capture_prefix) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s-%s.y4m", capture_prefix, res->name);
+            Raycast_StartCapture(raycast, path, CAPTURE_Y4M, FPS);
+        }
+
+        const double copy_ms = _bench_frames(raycast, renderer, &clock, frames, SDL_FALSE);
+
+        if (raycast->capture) {
+            printf("%-6s capture: %d frames recorded, %d dropped\n", res->name,
+                SDL_AtomicGet(&raycast->capture->pushed), SDL_AtomicGet(&raycast->capture->dropped));
+            Raycast_StopCapture(raycast);
+        }
+
+        Raycast_SetZeroCopy(raycast, SDL_TRUE);
+        const double zero_copy_ms = _bench_frames(raycast, renderer, &clock, frames, SDL_FALSE);
+
+        /* The copy path reads the buffer and writes the texture memory, the zero-copy path does neither */
+
+        const double saved_mb = 2. * res->w * res->h * sizeof(uint32_t) / 1e6;
+
+        printf("%-6s %ux%u: copy %.2f ms, zero-copy %.2f ms (%+.1f%%), %.1f MB not moved per frame, %.2f GB/s at the zero-copy frame rate\n",
+            res->name, res->w, res->h, copy_ms, zero_copy_ms, (zero_copy_ms / copy_ms - 1.) * 100.,
+            saved_mb, saved_mb / zero_copy_ms
+        );
+
+        total_ms += copy_ms + zero_copy_ms;
+
+        /* Serial against pipelined: the render thread casts the next frame while the main thread uploads the last one */
+
+        Raycast_SetZeroCopy(raycast, SDL_FALSE);
+        Raycast_SetPipeline(raycast, SDL_TRUE);
+        const double pipelined_ms = _bench_frames(raycast, renderer, &clock, frames, SDL_FALSE);
+        const double synced_ms = _bench_frames(raycast, renderer, &clock, frames, SDL_TRUE);
+        Raycast_SetPipeline(raycast, SDL_FALSE);
+
+        printf("%-6s %ux%u: serial %.2f ms, pipelined %.2f ms (%+.1f%%), %.2f ms with a sync each frame (%+.1f%%), one frame more of latency\n",
+            res->name, res->w, res->h, copy_ms, pipelined_ms, (pipelined_ms / copy_ms - 1.) * 100.,
+            synced_ms, (synced_ms / copy_ms - 1.) * 100.
+        );
+
+        Raycast_Free(raycast);
+        Window_Quit(window, renderer);
+    }
+
+    Map_Destroy(map);
+
+    // one number for the build profiles to compare (make profiles)
+    printf("score: %.3f ms per frame\n", total_ms / (2. * sizeof(resolutions) / sizeof(resolutions[0])));
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include "capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void _capture_scale_row(const Capture_Slot* slot, const uint16_t w, const uint16_t h, const int y, uint32_t* row) // nearest row of the frame at the size of the video
+{
+    const uint32_t* src = slot->pixels + (y * slot->h / h) * slot->w;
+
+    if (slot->w == w) memcpy(row, src, w * sizeof(uint32_t));
+    else for (int x = 0; x < w; x++) row[x] = src[x * slot->w / w];
+}
+
+SDL_bool _capture_write_raw(Capture* capture, const Capture_Slot* slot)
+{
+    uint32_t* row = (uint32_t*)capture->planes;
+
+    for (int y = 0; y < capture->h; y++) {
+        _capture_scale_row(slot, capture->w, capture->h, y, row);
+        if (fwrite(row, sizeof(uint32_t), capture->w, capture->file) != capture->w) return SDL_FALSE;
+    }
+
+    return SDL_TRUE;
+}
+
+SDL_bool _capture_write_y4m(Capture* capture, const Capture_Slot* slot) // BT.601 full range, the chroma of each 2x2 block is averaged
+{
+    const int w = capture->w, h = capture->h;
+    const int cw = w / 2, ch = h / 2;
+
+    uint8_t* luma = capture->planes;
+    uint8_t* cb = luma + w * h;
+    uint8_t* cr = cb + cw * ch;
+    uint32_t* rows = (uint32_t*)(cr + cw * ch); // two rows of the frame at the size of the video
+
+    for (int y = 0; y < h; y += 2)
+    {
+        _capture_scale_row(slot, w, h, y, rows);
+        _capture_scale_row(slot, w, h, y + 1, rows + w);
+
+        for (int x = 0; x < w; x += 2)
+        {
+            int r = 0, g = 0, b = 0;
+
+            for (int i = 0; i < 4; i++) {
+                const uint32_t color = rows[(i >> 1) * w + x + (i & 1)];
+                const int cr8 = color >> 16 & 0xFF, cg8 = color >> 8 & 0xFF, cb8 = color & 0xFF;
+                luma[(y + (i >> 1)) * w + x + (i & 1)] = (77 * cr8 + 150 * cg8 + 29 * cb8) >> 8;
+                r += cr8, g += cg8, b += cb8;
+            }
+
+            r >>= 2, g >>= 2, b >>= 2;
+            cb[(y / 2) * cw + x / 2] = (uint8_t)(128 + ((-43 * r - 85 * g + 128 * b) >> 8));
+            cr[(y / 2) * cw + x / 2] = (uint8_t)(128 + ((128 * r - 107 * g - 21 * b) >> 8));
+        }
+    }
+
+    const size_t size = w * h + 2 * cw * ch;
+    return fputs("FRAME\n", capture->file) >= 0 && fwrite(capture->planes, 1, size, capture->file) == size;
+}
+
+int _capture_writer(void* data)
+{
+    Capture* capture = data;
+
+    for (;;)
+    {
+        SDL_SemWait(capture->ready);
+
+        const int written = SDL_AtomicGet(&capture->written);
+
+        if (written == SDL_AtomicGet(&capture->pushed)) { // the last post, from Capture_Stop
+            if (SDL_AtomicGet(&capture->quit)) break;
+            continue;
+        }
+
+        const Capture_Slot* slot = &capture->slots[written % CAPTURE_SLOTS];
+
+        if (!SDL_AtomicGet(&capture->failed)) {
+            const SDL_bool ok = capture->format == CAPTURE_Y4M ? _capture_write_y4m(capture, slot) : _capture_write_raw(capture, slot);
+            if (!ok) SDL_AtomicSet(&capture->failed, 1); // the next frames are only released
+        }
+
+        SDL_AtomicSet(&capture->written, written + 1); // releases the slot
+    }
+
+    return 0;
+}
+
+Capture* Capture_Start(const char* path, const uint8_t format, const uint16_t w, const uint16_t h, const uint16_t fps)
+{
+    FILE* file = fopen(path, "wb");
+
+    if (!file) {
+        fprintf(stderr, "ERROR of Capture_Start: Unable to create \"%s\".\n", path);
+        return NULL;
+    }
+
+    Capture* capture = calloc(1, sizeof(Capture));
+
+    capture->file = file;
+    capture->format = format;
+    capture->w = format == CAPTURE_Y4M ? (w + 1) & ~1 : w; // 4:2:0 needs even sizes
+    capture->h = format == CAPTURE_Y4M ? (h + 1) & ~1 : h;
+    capture->fps = fps;
+
+    /* Everything the capture needs is allocated now, nothing is allocated per frame */
+
+    const size_t frame_size = (size_t)capture->w * capture->h * sizeof(uint32_t);
+    const size_t planes_size = (size_t)capture->w * capture->h * 3 / 2 + 2 * capture->w * sizeof(uint32_t);
+
+    size_t capacity = Arena_Reserve(0, planes_size, ARENA_PAGE);
+    for (int i = 0; i < CAPTURE_SLOTS; i++) capacity = Arena_Reserve(capacity, frame_size, ARENA_PAGE);
+
+    capture->arena = Arena_Create(capacity, 0);
+
+    if (!capture->arena) {
+        fclose(file); free(capture);
+        return NULL;
+    }
+
+    for (int i = 0; i < CAPTURE_SLOTS; i++)
+        capture->slots[i].pixels = Arena_Alloc(capture->arena, frame_size, ARENA_PAGE);
+
+    capture->planes = Arena_Alloc(capture->arena, planes_size, ARENA_PAGE);
+
+    if (format == CAPTURE_Y4M)
+        fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", capture->w, capture->h, fps);
+
+    capture->ready = SDL_CreateSemaphore(0);
+    capture->thread = SDL_CreateThread(_capture_writer, "raycast_capture", capture);
+
+    return capture;
+}
+
+SDL_bool Capture_Push(Capture* capture, const uint32_t* pixels, const uint32_t stride, const uint16_t w, const uint16_t h)
+{
+    const int pushed = SDL_AtomicGet(&capture->pushed);
+
+    if (pushed - SDL_AtomicGet(&capture->written) >= CAPTURE_SLOTS) { // the writer is behind
+        SDL_AtomicAdd(&capture->dropped, 1);
+        return SDL_FALSE;
+    }
+
+    Capture_Slot* slot = &capture->slots[pushed % CAPTURE_SLOTS];
+    slot->w = w < capture->w ? w : capture->w;
+    slot->h = h < capture->h ? h : capture->h;
+
+    for (int y = 0; y < slot->h; y++)
+        memcpy(slot->pixels + y * slot->w, pixels + y * stride, slot->w * sizeof(uint32_t));
+
+    SDL_AtomicSet(&capture->pushed, pushed + 1); // publishes the slot
+    SDL_SemPost(capture->ready);
+
+    return SDL_TRUE;
+}
+
+void Capture_Stop(Capture* capture)
+{
+    SDL_AtomicSet(&capture->quit, 1);
+    SDL_SemPost(capture->ready);
+    SDL_WaitThread(capture->thread, NULL);
+
+    if (SDL_AtomicGet(&capture->failed))
+        fprintf(stderr, "ERROR of Capture_Stop: The capture could not be written entirely.\n");
+
+    fclose(capture->file);
+    SDL_DestroySemaphore(capture->ready);
+    Arena_Destroy(capture->arena);
+    free(capture);
+}
+
+uint32_t Capture_Compare(const uint32_t* frame, const uint32_t* reference, const uint32_t count, const uint8_t tolerance, uint8_t* max_delta)
+{
+    uint32_t differ = 0;
+    int max = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (frame[i] == reference[i]) continue;
+
+        int delta = 0;
+
+        for (int shift = 0; shift < 24; shift += 8) { // the alpha is not compared, the frames are opaque
+            const int d = abs((int)(frame[i] >> shift & 0xFF) - (int)(reference[i] >> shift & 0xFF));
+            if (d > delta) delta = d;
+        }
+
+        if (delta > tolerance) differ++;
+        if (delta > max) max = delta;
+    }
+
+    if (max_delta) *max_delta = (uint8_t)max;
+
+    return differ;
+}
@@ -0,0 +1,74 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_stdinc.h>
+#include <SDL2/SDL_thread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+
+#define CAPTURE_RAW             0x00    // the ARGB8888 frames one after the other, w * h * 4 bytes each
+#define CAPTURE_Y4M             0x01    // YUV4MPEG2 4:2:0 (full range BT.601), played by mpv or converted by ffmpeg
+
+#define CAPTURE_SLOTS           8       // frames the ring can hold while the writer is behind
+
+// Frame capture: Capture_Push copies a frame in a free slot of a preallocated ring and returns at once, a writer
+// thread converts and writes the slots to the file. When the ring is full (the disk is behind) the frame is dropped
+// and counted, the caller never waits. Frames of another size than the video are scaled to it (nearest) by the writer.
+
+typedef struct {
+    uint32_t* pixels;
+    uint16_t w, h;
+} Capture_Slot;
+
+typedef struct {
+    FILE* file;
+    uint8_t format;
+    uint16_t w, h;              // size of the video, even for Y4M
+    uint16_t fps;
+
+    Arena* arena;               // the slots and the conversion buffer of the writer
+    Capture_Slot slots[CAPTURE_SLOTS];
+    uint8_t* planes;            // Y, then Cb and Cr at half resolution
+
+    SDL_atomic_t pushed;        // frames copied in the ring, written by the caller
+    SDL_atomic_t written;       // frames written to the file, written by the writer thread
+    SDL_atomic_t dropped;       // frames dropped because the ring was full
+    SDL_atomic_t failed;        // set by the writer if the file can't be written anymore
+    SDL_atomic_t quit;
+    SDL_sem* ready;             // posted for each frame pushed
+    SDL_Thread* thread;
+} Capture;
+
+Capture* Capture_Start( // NULL if the file can't be created
+    const char* path,
+    const uint8_t format,       // CAPTURE_RAW || CAPTURE_Y4M
+    const uint16_t w,
+    const uint16_t h,
+    const uint16_t fps          // only written in the Y4M header
+);
+
+SDL_bool Capture_Push( // SDL_FALSE if the frame was dropped, only one thread may push
+    Capture* capture,
+    const uint32_t* pixels,
+    const uint32_t stride,      // pixels between two rows
+    const uint16_t w,           // at most the size of the video
+    const uint16_t h
+);
+
+void Capture_Stop( // writes the frames left in the ring, then closes the file
+    Capture* capture
+);
+
+uint32_t Capture_Compare( // number of pixels whose red, green or blue differ by more than tolerance between two ARGB frames
+    const uint32_t* frame,
+    const uint32_t* reference,
+    const uint32_t count,       // pixels of each frame
+    const uint8_t tolerance,
+    uint8_t* max_delta          // receives the largest difference of a channel, can be NULL
+);
+
+#endif
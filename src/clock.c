@@ -1,19 +1,34 @@
 #include "clock.h"
 
+#include <SDL2/SDL_stdinc.h>
 #include <SDL2/SDL_timer.h>
 #include <stdint.h>
 
 Clock Clock_Init(void)
 {
     Clock clock;
-    clock.last_tick = 0;
-    clock.delta_ms  = 0;
-    clock.delta     = 0;
-    clock.t_fps     = 0;
-    clock.fps       = 0;
+    clock.last_tick   = SDL_GetTicks();
+    clock.delta_ms    = 0;
+    clock.delta       = 0;
+    clock.t_fps       = 0;
+    clock.fps         = 0;
+    clock.frame_ms    = TPF;
+    clock.step        = 1.f / TICK_RATE;
+    clock.accumulator = 0;
+    clock.alpha       = 1;
     return clock;
 }
 
+void Clock_SetFrameRate(Clock* clock, const uint16_t fps)
+{
+    clock->frame_ms = fps ? 1000 / fps : 0;
+}
+
+void Clock_SetTickRate(Clock* clock, const uint16_t tick_rate)
+{
+    clock->step = 1.f / tick_rate;
+}
+
 void Clock_Update(Clock* clock)
 {
     uint32_t act_tick = SDL_GetTicks();
@@ -28,10 +43,23 @@ void Clock_Update(Clock* clock)
         clock->fps = 1.f / clock->delta;
         clock->t_fps = 0.f;
     }
+
+    clock->accumulator += clock->delta;
+    if (clock->accumulator > CLOCK_MAX_LAG) clock->accumulator = CLOCK_MAX_LAG; // after a stall, don't try to catch up all at once
+}
+
+SDL_bool Clock_Tick(Clock* clock)
+{
+    const SDL_bool tick = clock->accumulator >= clock->step;
+    if (tick) clock->accumulator -= clock->step;
+
+    clock->alpha = clock->accumulator / clock->step;
+
+    return tick;
 }
 
 void Clock_Limit(Clock *clock)
 {
-    if (SDL_GetTicks() < (clock->last_tick + TPF))
-        SDL_Delay((clock->last_tick + TPF) - SDL_GetTicks());
+    if (clock->frame_ms && SDL_GetTicks() < (clock->last_tick + clock->frame_ms))
+        SDL_Delay((clock->last_tick + clock->frame_ms) - SDL_GetTicks());
 }
@@ -1,22 +1,41 @@
 #ifndef _CLOCK_H_
 #define _CLOCK_H_
 
+#include <SDL2/SDL_stdinc.h>
 #include <stdint.h>
 
 #define FPS 60
+#define TICK_RATE 60
 
 #define TPF 1000/FPS
 
+#define CLOCK_MAX_LAG .25f // seconds of simulation kept at most in the accumulator, beyond it the simulation slows down
+
+// The simulation runs at a fixed step, independent of the frame rate:
+//
+//     Clock_Update(&clock);
+//     while (Clock_Tick(&clock)) Raycast_Update(raycast, &clock);
+//     Raycast_Render(raycast, renderer, &clock);
+//
+// clock -> alpha: fraction of step elapsed since the last tick, used to interpolate the state at render time.
+
 typedef struct {
     uint32_t last_tick;
     uint32_t delta_ms;
     float delta;
     float t_fps;
     uint16_t fps;
+    uint16_t frame_ms;      // frame time of Clock_Limit, 0 for no limit
+    float step;             // fixed simulation step in seconds
+    float accumulator;
+    float alpha;
 } Clock;
 
 Clock Clock_Init(void);
+void Clock_SetFrameRate(Clock* clock, const uint16_t fps); // 0 for no limit
+void Clock_SetTickRate(Clock* clock, const uint16_t tick_rate);
 void Clock_Update(Clock* clock);
+SDL_bool Clock_Tick(Clock* clock); // consumes one step of the accumulator, returns SDL_FALSE when it is too short
 void Clock_Limit(Clock* clock);
 
-#endif
\ No newline at end of file
+#endif
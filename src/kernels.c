@@ -0,0 +1,36 @@
+#include "kernels.h"
+
+#include <SDL2/SDL_cpuinfo.h>
+#include <SDL2/SDL_stdinc.h>
+#include <stdio.h>
+#include <string.h>
+
+const Kernels kernels_scalar = { "scalar", NULL, { NULL, NULL }, NULL };
+
+const Kernels* Kernels_Find(const char* name)
+{
+    if (!strcmp(name, "scalar")) return &kernels_scalar;
+    if (!strcmp(name, "avx2")) return SDL_HasAVX2() ? Kernels_GetAVX2() : NULL;
+    if (!strcmp(name, "sse4.1")) return SDL_HasSSE41() ? Kernels_GetSSE41() : NULL;
+    if (!strcmp(name, "neon")) return SDL_HasNEON() ? Kernels_GetNEON() : NULL;
+    return NULL;
+}
+
+const Kernels* Kernels_Select(void)
+{
+    const char* names[] = { "avx2", "sse4.1", "neon", "scalar" }; // by order of preference
+    const char* forced = SDL_getenv("RAYCAST_KERNEL");
+
+    if (forced) {
+        const Kernels* kernels = Kernels_Find(forced);
+        if (kernels) return kernels;
+        fprintf(stderr, "ERROR of Kernels_Select: The kernels \"%s\" are not available (scalar, sse4.1, avx2 or neon), the best ones are used.\n", forced);
+    }
+
+    for (unsigned i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        const Kernels* kernels = Kernels_Find(names[i]);
+        if (kernels) return kernels;
+    }
+
+    return &kernels_scalar;
+}
@@ -0,0 +1,59 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include <stdint.h>
+
+#include "textures.h"
+
+// The inner loops of the 32 bits mode work on a row of floor/ceiling or a wall column described below. The position
+// of the n-th pixel is always computed as origin + n * stride (never accumulated), so that every variant of a kernel,
+// scalar or vectorized, casts the same pixels bit for bit.
+
+struct _Raycast_Row {           // a floor or ceiling row, cast span after span
+    uint32_t* out;
+    float x, y;                 // world position of the pixel x_first
+    float stride_x, stride_y;   // world step between two pixels cast
+    int x_first, x_step;
+    int cell_x, cell_y;         // cell of the current span, updated when a kernel stops on a new one
+    const Pixel* tex;
+    int tex_w, tex_h;
+    uint32_t color;             // default color when there is no texture, already lit
+    uint8_t light;
+};
+
+struct _Raycast_Column {        // a textured wall column
+    uint32_t* out;
+    int stride;                 // pixels between two rows filled
+    int count;
+    const Pixel* tex;           // column of the texture
+    int tex_w, tex_h;
+    float tex_pos, tex_step;
+    uint8_t light;
+};
+
+typedef int (*_Raycast_RowKernel)(struct _Raycast_Row* row, int x, const int x_end); // returns the column where it stopped
+typedef void (*_Raycast_ColumnKernel)(const struct _Raycast_Column* column);
+
+// A set of kernels built for one instruction set, the NULL ones keep the scalar kernels of the raycaster.
+// Each set is compiled in its own file with the flags of its instruction set, and only used if the CPU has it.
+
+typedef struct {
+    const char* name;
+    _Raycast_RowKernel row;                 // textured row without light nor spans, any power of two size
+    _Raycast_ColumnKernel column[2];        // unlit wall column, by side
+    void (*expand)(uint32_t* dst, const uint8_t* src, const Pixel* colors, const int count); // palette lookup of a row
+} Kernels;
+
+const Kernels* Kernels_GetSSE41(void);  // NULL if the file was not built for the instruction set
+const Kernels* Kernels_GetAVX2(void);
+const Kernels* Kernels_GetNEON(void);
+
+const Kernels* Kernels_Find( // the set of that name (scalar, sse4.1, avx2 or neon), NULL if it was not built or the CPU lacks it
+    const char* name
+);
+
+const Kernels* Kernels_Select( // the best set supported by the CPU, or the one named by the RAYCAST_KERNEL environment variable
+    void
+);
+
+#endif
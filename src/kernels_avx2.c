@@ -0,0 +1,124 @@
+#include "kernels.h"
+
+#include <stddef.h>
+
+#ifdef __AVX2__ // built with -mavx2 (see the Makefile), only called when SDL_HasAVX2
+
+#include <immintrin.h>
+
+/* AVX2: 8 pixels per step, the texels are fetched by a gather. The float operations are the ones of the scalar
+   kernels in the same order, and without FMA, so that the pixels are identical. */
+
+int _row_avx2(struct _Raycast_Row* row, int x, const int x_end)
+{
+    const __m256 origin_x = _mm256_set1_ps(row->x), origin_y = _mm256_set1_ps(row->y);
+    const __m256 stride_x = _mm256_set1_ps(row->stride_x), stride_y = _mm256_set1_ps(row->stride_y);
+    const __m256 tex_w = _mm256_set1_ps((float)row->tex_w), tex_h = _mm256_set1_ps((float)row->tex_h);
+    const __m256i mask_w = _mm256_set1_epi32(row->tex_w - 1), mask_h = _mm256_set1_epi32(row->tex_h - 1);
+    const __m256i width = _mm256_set1_epi32(row->tex_w), dark = _mm256_set1_epi32(8355711);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int n = (x - row->x_first) / row->x_step;
+
+    while (x + 7 * row->x_step < x_end)
+    {
+        const __m256 fn = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(n), lanes));
+        const __m256 floor_x = _mm256_add_ps(origin_x, _mm256_mul_ps(fn, stride_x));
+        const __m256 floor_y = _mm256_add_ps(origin_y, _mm256_mul_ps(fn, stride_y));
+        const __m256 cell_x = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(floor_x));
+        const __m256 cell_y = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(floor_y));
+
+        const __m256i tx = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(tex_w, _mm256_sub_ps(floor_x, cell_x))), mask_w);
+        const __m256i ty = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(tex_h, _mm256_sub_ps(floor_y, cell_y))), mask_h);
+        const __m256i texel = _mm256_i32gather_epi32((const int*)row->tex, _mm256_add_epi32(_mm256_mullo_epi32(ty, width), tx), 4);
+        const __m256i color = _mm256_and_si256(_mm256_srli_epi32(texel, 1), dark);
+
+        if (row->x_step == 1) _mm256_storeu_si256((__m256i*)(row->out + x), color);
+        else {
+            uint32_t colors[8];
+            _mm256_storeu_si256((__m256i*)colors, color);
+            for (int i = 0; i < 8; i++) row->out[x + i * row->x_step] = colors[i];
+        }
+
+        x += 8 * row->x_step, n += 8;
+    }
+
+    for (; x < x_end; x += row->x_step, n++) // the last pixels
+    {
+        const float floor_x = row->x + (float)n * row->stride_x;
+        const float floor_y = row->y + (float)n * row->stride_y;
+        const int cell_x = (int)(floor_x);
+        const int cell_y = (int)(floor_y);
+
+        const int tx = (int)(row->tex_w * (floor_x - cell_x)) & (row->tex_w - 1);
+        const int ty = (int)(row->tex_h * (floor_y - cell_y)) & (row->tex_h - 1);
+        row->out[x] = row->tex[ty * row->tex_w + tx] >> 1 & 8355711;
+    }
+
+    return x;
+}
+
+#define COLUMN_AVX2(NAME, SIDE)                                                                 \
+void NAME(const struct _Raycast_Column* column)                                                 \
+{                                                                                               \
+    const __m256 tex_pos = _mm256_set1_ps(column->tex_pos);                                     \
+    const __m256 tex_step = _mm256_set1_ps(column->tex_step);                                   \
+    const __m256i mask_h = _mm256_set1_epi32(column->tex_h - 1);                                \
+    const __m256i width = _mm256_set1_epi32(column->tex_w), dark = _mm256_set1_epi32(8355711); \
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);                            \
+    uint32_t* out = column->out;                                                                \
+    int i = 0;                                                                                  \
+                                                                                                \
+    for (; i + 8 <= column->count; i += 8)                                                      \
+    {                                                                                           \
+        const __m256 fi = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes));    \
+        const __m256i tex_y = _mm256_and_si256(_mm256_cvttps_epi32(                             \
+            _mm256_add_ps(tex_pos, _mm256_mul_ps(fi, tex_step))), mask_h);                      \
+        __m256i color = _mm256_i32gather_epi32((const int*)column->tex,                         \
+            _mm256_mullo_epi32(tex_y, width), 4);                                               \
+        if (SIDE) color = _mm256_and_si256(_mm256_srli_epi32(color, 1), dark);                  \
+                                                                                                \
+        uint32_t colors[8];                                                                     \
+        _mm256_storeu_si256((__m256i*)colors, color);                                           \
+        for (int k = 0; k < 8; k++, out += column->stride) *out = colors[k];                    \
+    }                                                                                           \
+                                                                                                \
+    for (; i < column->count; i++, out += column->stride)                                       \
+    {                                                                                           \
+        const int tex_y = (int)(column->tex_pos + (float)i * column->tex_step) & (column->tex_h - 1); \
+        uint32_t color = column->tex[tex_y * column->tex_w];                                    \
+        if (SIDE) color = (color >> 1) & 8355711;                                               \
+        *out = color;                                                                           \
+    }                                                                                           \
+}
+
+COLUMN_AVX2(_column_avx2, 0)
+COLUMN_AVX2(_column_avx2_side, 1)
+
+void _expand_avx2(uint32_t* dst, const uint8_t* src, const Pixel* colors, const int count)
+{
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_i32gather_epi32((const int*)colors, indices, 4));
+    }
+
+    for (; x < count; x++) dst[x] = colors[src[x]];
+}
+
+const Kernels kernels_avx2 = { "avx2", _row_avx2, { _column_avx2, _column_avx2_side }, _expand_avx2 };
+
+const Kernels* Kernels_GetAVX2(void)
+{
+    return &kernels_avx2;
+}
+
+#else
+
+const Kernels* Kernels_GetAVX2(void)
+{
+    return NULL;
+}
+
+#endif
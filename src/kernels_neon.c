@@ -0,0 +1,113 @@
+#include "kernels.h"
+
+#include <stddef.h>
+
+#if defined(__ARM_NEON) && defined(__aarch64__) // NEON is part of AArch64, no flag is needed (see the Makefile)
+
+#include <arm_neon.h>
+
+/* NEON: the coordinates of 4 pixels per step are computed together, the texels are fetched one by one as there is no
+   gather. The file is built with -ffp-contract=off like the others, a fused multiply-add would round differently
+   than the scalar kernels. */
+
+int _row_neon(struct _Raycast_Row* row, int x, const int x_end)
+{
+    const float32x4_t origin_x = vdupq_n_f32(row->x), origin_y = vdupq_n_f32(row->y);
+    const float32x4_t stride_x = vdupq_n_f32(row->stride_x), stride_y = vdupq_n_f32(row->stride_y);
+    const float32x4_t tex_w = vdupq_n_f32((float)row->tex_w), tex_h = vdupq_n_f32((float)row->tex_h);
+    const int32x4_t mask_w = vdupq_n_s32(row->tex_w - 1), mask_h = vdupq_n_s32(row->tex_h - 1);
+    const int32x4_t width = vdupq_n_s32(row->tex_w);
+    const int32_t lane_init[4] = { 0, 1, 2, 3 };
+    const int32x4_t lanes = vld1q_s32(lane_init);
+
+    int n = (x - row->x_first) / row->x_step;
+
+    while (x + 3 * row->x_step < x_end)
+    {
+        const float32x4_t fn = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(n), lanes));
+        const float32x4_t floor_x = vaddq_f32(origin_x, vmulq_f32(fn, stride_x));
+        const float32x4_t floor_y = vaddq_f32(origin_y, vmulq_f32(fn, stride_y));
+        const float32x4_t cell_x = vcvtq_f32_s32(vcvtq_s32_f32(floor_x));
+        const float32x4_t cell_y = vcvtq_f32_s32(vcvtq_s32_f32(floor_y));
+
+        const int32x4_t tx = vandq_s32(vcvtq_s32_f32(vmulq_f32(tex_w, vsubq_f32(floor_x, cell_x))), mask_w);
+        const int32x4_t ty = vandq_s32(vcvtq_s32_f32(vmulq_f32(tex_h, vsubq_f32(floor_y, cell_y))), mask_h);
+        const int32x4_t index = vaddq_s32(vmulq_s32(ty, width), tx);
+
+        uint32_t* out = row->out + x;
+        out[0] = row->tex[vgetq_lane_s32(index, 0)] >> 1 & 8355711;
+        out[row->x_step] = row->tex[vgetq_lane_s32(index, 1)] >> 1 & 8355711;
+        out[2 * row->x_step] = row->tex[vgetq_lane_s32(index, 2)] >> 1 & 8355711;
+        out[3 * row->x_step] = row->tex[vgetq_lane_s32(index, 3)] >> 1 & 8355711;
+
+        x += 4 * row->x_step, n += 4;
+    }
+
+    for (; x < x_end; x += row->x_step, n++) // the last pixels
+    {
+        const float floor_x = row->x + (float)n * row->stride_x;
+        const float floor_y = row->y + (float)n * row->stride_y;
+        const int cell_x = (int)(floor_x);
+        const int cell_y = (int)(floor_y);
+
+        const int tx = (int)(row->tex_w * (floor_x - cell_x)) & (row->tex_w - 1);
+        const int ty = (int)(row->tex_h * (floor_y - cell_y)) & (row->tex_h - 1);
+        row->out[x] = row->tex[ty * row->tex_w + tx] >> 1 & 8355711;
+    }
+
+    return x;
+}
+
+#define COLUMN_NEON(NAME, SIDE)                                                                 \
+void NAME(const struct _Raycast_Column* column)                                                 \
+{                                                                                               \
+    const float32x4_t tex_pos = vdupq_n_f32(column->tex_pos);                                   \
+    const float32x4_t tex_step = vdupq_n_f32(column->tex_step);                                 \
+    const int32x4_t mask_h = vdupq_n_s32(column->tex_h - 1);                                    \
+    const int32x4_t width = vdupq_n_s32(column->tex_w);                                         \
+    const int32_t lane_init[4] = { 0, 1, 2, 3 };                                                \
+    const int32x4_t lanes = vld1q_s32(lane_init);                                               \
+    uint32_t* out = column->out;                                                                \
+    int i = 0;                                                                                  \
+                                                                                                \
+    for (; i + 4 <= column->count; i += 4)                                                      \
+    {                                                                                           \
+        const float32x4_t fi = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(i), lanes));                 \
+        const int32x4_t index = vmulq_s32(vandq_s32(vcvtq_s32_f32(                              \
+            vaddq_f32(tex_pos, vmulq_f32(fi, tex_step))), mask_h), width);                      \
+                                                                                                \
+        int32_t indices[4];                                                                     \
+        vst1q_s32(indices, index);                                                              \
+        for (int k = 0; k < 4; k++, out += column->stride) {                                    \
+            const uint32_t color = column->tex[indices[k]];                                     \
+            *out = SIDE ? (color >> 1) & 8355711 : color;                                       \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    for (; i < column->count; i++, out += column->stride)                                       \
+    {                                                                                           \
+        const int tex_y = (int)(column->tex_pos + (float)i * column->tex_step) & (column->tex_h - 1); \
+        uint32_t color = column->tex[tex_y * column->tex_w];                                    \
+        if (SIDE) color = (color >> 1) & 8355711;                                               \
+        *out = color;                                                                           \
+    }                                                                                           \
+}
+
+COLUMN_NEON(_column_neon, 0)
+COLUMN_NEON(_column_neon_side, 1)
+
+const Kernels kernels_neon = { "neon", _row_neon, { _column_neon, _column_neon_side }, NULL }; // no gather for the palette lookups
+
+const Kernels* Kernels_GetNEON(void)
+{
+    return &kernels_neon;
+}
+
+#else
+
+const Kernels* Kernels_GetNEON(void)
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "kernels.h"
+
+#include <stddef.h>
+
+#ifdef __SSE4_1__ // built with -msse4.1 (see the Makefile), only called when SDL_HasSSE41
+
+#include <smmintrin.h>
+
+/* SSE4.1: the coordinates of 4 pixels per step are computed together (mullo_epi32 is the SSE4.1 part), the texels are
+   fetched one by one as there is no gather. Same float operations as the scalar kernels, so the same pixels. */
+
+int _row_sse41(struct _Raycast_Row* row, int x, const int x_end)
+{
+    const __m128 origin_x = _mm_set1_ps(row->x), origin_y = _mm_set1_ps(row->y);
+    const __m128 stride_x = _mm_set1_ps(row->stride_x), stride_y = _mm_set1_ps(row->stride_y);
+    const __m128 tex_w = _mm_set1_ps((float)row->tex_w), tex_h = _mm_set1_ps((float)row->tex_h);
+    const __m128i mask_w = _mm_set1_epi32(row->tex_w - 1), mask_h = _mm_set1_epi32(row->tex_h - 1);
+    const __m128i width = _mm_set1_epi32(row->tex_w);
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+    int n = (x - row->x_first) / row->x_step;
+
+    while (x + 3 * row->x_step < x_end)
+    {
+        const __m128 fn = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(n), lanes));
+        const __m128 floor_x = _mm_add_ps(origin_x, _mm_mul_ps(fn, stride_x));
+        const __m128 floor_y = _mm_add_ps(origin_y, _mm_mul_ps(fn, stride_y));
+        const __m128 cell_x = _mm_cvtepi32_ps(_mm_cvttps_epi32(floor_x));
+        const __m128 cell_y = _mm_cvtepi32_ps(_mm_cvttps_epi32(floor_y));
+
+        const __m128i tx = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(tex_w, _mm_sub_ps(floor_x, cell_x))), mask_w);
+        const __m128i ty = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(tex_h, _mm_sub_ps(floor_y, cell_y))), mask_h);
+        const __m128i index = _mm_add_epi32(_mm_mullo_epi32(ty, width), tx);
+
+        uint32_t* out = row->out + x;
+        out[0] = row->tex[_mm_extract_epi32(index, 0)] >> 1 & 8355711;
+        out[row->x_step] = row->tex[_mm_extract_epi32(index, 1)] >> 1 & 8355711;
+        out[2 * row->x_step] = row->tex[_mm_extract_epi32(index, 2)] >> 1 & 8355711;
+        out[3 * row->x_step] = row->tex[_mm_extract_epi32(index, 3)] >> 1 & 8355711;
+
+        x += 4 * row->x_step, n += 4;
+    }
+
+    for (; x < x_end; x += row->x_step, n++) // the last pixels
+    {
+        const float floor_x = row->x + (float)n * row->stride_x;
+        const float floor_y = row->y + (float)n * row->stride_y;
+        const int cell_x = (int)(floor_x);
+        const int cell_y = (int)(floor_y);
+
+        const int tx = (int)(row->tex_w * (floor_x - cell_x)) & (row->tex_w - 1);
+        const int ty = (int)(row->tex_h * (floor_y - cell_y)) & (row->tex_h - 1);
+        row->out[x] = row->tex[ty * row->tex_w + tx] >> 1 & 8355711;
+    }
+
+    return x;
+}
+
+#define COLUMN_SSE41(NAME, SIDE)                                                                \
+void NAME(const struct _Raycast_Column* column)                                                 \
+{                                                                                               \
+    const __m128 tex_pos = _mm_set1_ps(column->tex_pos);                                        \
+    const __m128 tex_step = _mm_set1_ps(column->tex_step);                                      \
+    const __m128i mask_h = _mm_set1_epi32(column->tex_h - 1);                                   \
+    const __m128i width = _mm_set1_epi32(column->tex_w);                                        \
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);                                           \
+    uint32_t* out = column->out;                                                                \
+    int i = 0;                                                                                  \
+                                                                                                \
+    for (; i + 4 <= column->count; i += 4)                                                      \
+    {                                                                                           \
+        const __m128 fi = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), lanes));             \
+        const __m128i index = _mm_mullo_epi32(_mm_and_si128(_mm_cvttps_epi32(                   \
+            _mm_add_ps(tex_pos, _mm_mul_ps(fi, tex_step))), mask_h), width);                    \
+                                                                                                \
+        uint32_t indices[4];                                                                    \
+        _mm_storeu_si128((__m128i*)indices, index);                                             \
+        for (int k = 0; k < 4; k++, out += column->stride) {                                    \
+            const uint32_t color = column->tex[indices[k]];                                     \
+            *out = SIDE ? (color >> 1) & 8355711 : color;                                       \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    for (; i < column->count; i++, out += column->stride)                                       \
+    {                                                                                           \
+        const int tex_y = (int)(column->tex_pos + (float)i * column->tex_step) & (column->tex_h - 1); \
+        uint32_t color = column->tex[tex_y * column->tex_w];                                    \
+        if (SIDE) color = (color >> 1) & 8355711;                                               \
+        *out = color;                                                                           \
+    }                                                                                           \
+}
+
+COLUMN_SSE41(_column_sse41, 0)
+COLUMN_SSE41(_column_sse41_side, 1)
+
+const Kernels kernels_sse41 = { "sse4.1", _row_sse41, { _column_sse41, _column_sse41_side }, NULL }; // no gather for the palette lookups
+
+const Kernels* Kernels_GetSSE41(void)
+{
+    return &kernels_sse41;
+}
+
+#else
+
+const Kernels* Kernels_GetSSE41(void)
+{
+    return NULL;
+}
+
+#endif
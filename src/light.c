@@ -0,0 +1,239 @@
+#include "light.h"
+
+#include <SDL2/SDL_stdinc.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "map.h"
+
+#define LIGHT_FACE_OFFSET .01f  // the faces are lit from a point just in front of them
+
+SDL_bool _is_lit(const Map* map, const float lx, const float ly, const float tx, const float ty) // whether no wall stands between the light and the target
+{
+    int cell_x = (int)lx, cell_y = (int)ly;
+    const int end_x = (int)tx, end_y = (int)ty;
+
+    const float dx = tx - lx, dy = ty - ly;
+    const int step_x = dx < 0 ? -1 : 1, step_y = dy < 0 ? -1 : 1;
+
+    /* DDA along the segment, side_x and side_y are the fractions of the segment where the next x and y sides are */
+
+    const float delta_x = dx == 0 ? 1e30 : fabsf(1 / dx);
+    const float delta_y = dy == 0 ? 1e30 : fabsf(1 / dy);
+    float side_x = (dx < 0 ? lx - cell_x : cell_x + 1.f - lx) * delta_x;
+    float side_y = (dy < 0 ? ly - cell_y : cell_y + 1.f - ly) * delta_y;
+
+    while (cell_x != end_x || cell_y != end_y)
+    {
+        if (side_x > 1.f && side_y > 1.f) break; // the end of the segment is reached (it can be missed by a corner)
+
+        if (side_x < side_y) side_x += delta_x, cell_x += step_x;
+        else                 side_y += delta_y, cell_y += step_y;
+
+        if (cell_x == end_x && cell_y == end_y) break;
+        if (cell_x < 0 || cell_y < 0 || cell_x > map->width || cell_y > map->height) return SDL_FALSE;
+        if (map->data[cell_x][cell_y] > 0) return SDL_FALSE;
+    }
+
+    return SDL_TRUE;
+}
+
+SDL_bool _is_open(const Map* map, const int x, const int y) // the faces toward a free cell or a low wall can be seen
+{
+    return !map->data[x][y] || Map_GetHeight(map, x, y) < MAP_WALL_HEIGHT;
+}
+
+uint8_t _bake_point(const Lightmap* lightmap, const float px, const float py, const float nx, const float ny) // light received at a point, facing (nx, ny) or the ceiling if null
+{
+    float light = lightmap->ambient;
+
+    for (uint32_t i = 0; i < lightmap->light_count; i++)
+    {
+        const Light* l = &lightmap->lights[i];
+        const float dx = l->x - px, dy = l->y - py;
+        const float dist = sqrtf(dx * dx + dy * dy);
+
+        if (dist >= l->radius) continue;
+
+        float factor = 1.f - dist / l->radius;
+        factor *= factor;
+
+        if (nx != 0 || ny != 0) { // faces are lit with the cosine of the light direction
+            if (dist == 0) continue;
+            factor *= (nx * dx + ny * dy) / dist;
+            if (factor <= 0) continue;
+        }
+
+        if (!_is_lit(lightmap->map, l->x, l->y, px, py)) continue;
+
+        light += l->intensity * factor;
+    }
+
+    return light >= 1.f ? 255 : light <= 0.f ? 0 : (uint8_t)(light * 255);
+}
+
+void _light_bounds(const Light* light, int* x0, int* y0, int* x1, int* y1) // cells lit by a light, with their neighbours for the faces
+{
+    *x0 = floorf(light->x - light->radius) - 1, *y0 = floorf(light->y - light->radius) - 1;
+    *x1 = ceilf(light->x + light->radius) + 1, *y1 = ceilf(light->y + light->radius) + 1;
+}
+
+Lightmap* Lightmap_Create(const Map* map, const float ambient, const uint32_t capacity)
+{
+    Lightmap* lightmap = malloc(sizeof(Lightmap));
+
+    lightmap->map = Map_Retain((Map*)map);
+    lightmap->stride = map->width + 1;
+    lightmap->ambient = ambient;
+    lightmap->generation = map->generation;
+
+    lightmap->lights = malloc(sizeof(Light) * capacity);
+    lightmap->light_count = 0;
+    lightmap->light_capacity = capacity;
+
+    const uint32_t cells = lightmap->stride * (map->height + 1);
+    lightmap->cells = malloc(cells);
+    lightmap->faces = malloc(cells * 4);
+
+    Lightmap_Relight(lightmap, 0, 0, map->width, map->height);
+
+    return lightmap;
+}
+
+int32_t Lightmap_AddLight(Lightmap* lightmap, const float x, const float y, const float radius, const float intensity)
+{
+    if (lightmap->light_count == lightmap->light_capacity) return -1;
+
+    Light* light = &lightmap->lights[lightmap->light_count++];
+    *light = (Light){ x, y, radius, intensity };
+
+    int x0, y0, x1, y1;
+    _light_bounds(light, &x0, &y0, &x1, &y1);
+    Lightmap_Relight(lightmap, x0, y0, x1, y1);
+
+    return lightmap->light_count - 1;
+}
+
+void Lightmap_MoveLight(Lightmap* lightmap, const uint32_t id, const float x, const float y)
+{
+    Light* light = &lightmap->lights[id];
+
+    /* Both the old and the new areas of the light are relit, as one rectangle if they overlap */
+
+    int ox0, oy0, ox1, oy1, nx0, ny0, nx1, ny1;
+    _light_bounds(light, &ox0, &oy0, &ox1, &oy1);
+    light->x = x, light->y = y;
+    _light_bounds(light, &nx0, &ny0, &nx1, &ny1);
+
+    if (ox0 > nx1 || nx0 > ox1 || oy0 > ny1 || ny0 > oy1) {
+        Lightmap_Relight(lightmap, ox0, oy0, ox1, oy1);
+        Lightmap_Relight(lightmap, nx0, ny0, nx1, ny1);
+    }
+    else Lightmap_Relight(lightmap,
+        ox0 < nx0 ? ox0 : nx0, oy0 < ny0 ? oy0 : ny0,
+        ox1 > nx1 ? ox1 : nx1, oy1 > ny1 ? oy1 : ny1
+    );
+}
+
+void Lightmap_RemoveLight(Lightmap* lightmap, const uint32_t id)
+{
+    int x0, y0, x1, y1;
+    _light_bounds(&lightmap->lights[id], &x0, &y0, &x1, &y1);
+
+    lightmap->lights[id] = lightmap->lights[--lightmap->light_count];
+
+    Lightmap_Relight(lightmap, x0, y0, x1, y1);
+}
+
+void Lightmap_UpdateCell(Lightmap* lightmap, const int x, const int y)
+{
+    Lightmap_UpdateRect(lightmap, x, y, x, y);
+}
+
+void Lightmap_UpdateRect(Lightmap* lightmap, const int x0, const int y0, const int x1, const int y1)
+{
+    /* The cells change the shadows of every light reaching them, and the faces of their neighbours */
+
+    int rx0 = x0 - 1, ry0 = y0 - 1, rx1 = x1 + 1, ry1 = y1 + 1;
+
+    for (uint32_t i = 0; i < lightmap->light_count; i++)
+    {
+        const Light* light = &lightmap->lights[i];
+
+        // distance from the light to the nearest point of the rectangle
+        const float dx = fmaxf(0.f, fmaxf(x0 - light->x, light->x - (x1 + 1)));
+        const float dy = fmaxf(0.f, fmaxf(y0 - light->y, light->y - (y1 + 1)));
+        if (dx * dx + dy * dy >= light->radius * light->radius) continue;
+
+        int lx0, ly0, lx1, ly1;
+        _light_bounds(light, &lx0, &ly0, &lx1, &ly1);
+
+        if (lx0 < rx0) rx0 = lx0;
+        if (ly0 < ry0) ry0 = ly0;
+        if (lx1 > rx1) rx1 = lx1;
+        if (ly1 > ry1) ry1 = ly1;
+    }
+
+    Lightmap_Relight(lightmap, rx0, ry0, rx1, ry1);
+}
+
+SDL_bool Lightmap_Sync(Lightmap* lightmap)
+{
+    const Map* map = lightmap->map;
+    if (lightmap->generation == map->generation) return SDL_FALSE;
+
+    /* The edits are relit one by one while they are logged, rather than the rectangle around all of them */
+
+    if (map->generation - lightmap->generation > MAP_DIRTY_LOG)
+        Lightmap_Relight(lightmap, 0, 0, map->width, map->height);
+    else for (uint32_t g = lightmap->generation; g != map->generation; g++) {
+        const SDL_Rect* rect = &map->dirty[g % MAP_DIRTY_LOG];
+        Lightmap_UpdateRect(lightmap, rect->x, rect->y, rect->x + rect->w - 1, rect->y + rect->h - 1);
+    }
+
+    lightmap->generation = map->generation;
+
+    return SDL_TRUE;
+}
+
+void Lightmap_Relight(Lightmap* lightmap, int x0, int y0, int x1, int y1)
+{
+    const Map* map = lightmap->map;
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > map->width) x1 = map->width;
+    if (y1 > map->height) y1 = map->height;
+
+    for (int y = y0; y <= y1; y++) for (int x = x0; x <= x1; x++)
+    {
+        const uint32_t cell = y * lightmap->stride + x;
+        uint8_t* faces = &lightmap->faces[cell * 4];
+
+        if (map->data[x][y] == 0) {
+            lightmap->cells[cell] = _bake_point(lightmap, x + .5f, y + .5f, 0, 0);
+            faces[0] = faces[1] = faces[2] = faces[3] = 0;
+            continue;
+        }
+
+        /* Wall: only its faces toward free cells and low walls can be seen, in the order west, east, north, south */
+
+        lightmap->cells[cell] = 0;
+
+        faces[0] = x > 0 && _is_open(map, x-1, y) ? _bake_point(lightmap, x - LIGHT_FACE_OFFSET, y + .5f, -1, 0) : 0;
+        faces[1] = x < map->width && _is_open(map, x+1, y) ? _bake_point(lightmap, x + 1 + LIGHT_FACE_OFFSET, y + .5f, 1, 0) : 0;
+        faces[2] = y > 0 && _is_open(map, x, y-1) ? _bake_point(lightmap, x + .5f, y - LIGHT_FACE_OFFSET, 0, -1) : 0;
+        faces[3] = y < map->height && _is_open(map, x, y+1) ? _bake_point(lightmap, x + .5f, y + 1 + LIGHT_FACE_OFFSET, 0, 1) : 0;
+    }
+}
+
+void Lightmap_Destroy(Lightmap* lightmap)
+{
+    Map_Destroy((Map*)lightmap->map);
+
+    free(lightmap->lights);
+    free(lightmap->cells);
+    free(lightmap->faces);
+    free(lightmap);
+}
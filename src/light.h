@@ -0,0 +1,86 @@
+#ifndef _LIGHT_H_
+#define _LIGHT_H_
+
+#include <SDL2/SDL_stdinc.h>
+#include <stdint.h>
+
+#include "map.h"
+
+typedef struct {
+    float x, y;
+    float radius;               // the light fades to nothing at this distance
+    float intensity;            // added to the ambient light at the center, 1 is full bright
+} Light;
+
+// Light levels are baked per map cell (for its floor and ceiling) and per wall face, 255 being full bright.
+// Cells are indexed by y * (map->width + 1) + x, and faces by cell * 4 + face (FACE_WEST, FACE_EAST, FACE_NORTH, FACE_SOUTH).
+// Adding, moving or removing a light only relights the cells within its radius, and a changed cell only
+// relights the area of the lights reaching it (see Lightmap_UpdateCell). Lightmap_Sync does it for the cells edited
+// with Map_SetCell and Map_FillRect since the last sync.
+
+typedef struct {
+    const Map* map;
+    uint16_t stride;
+    float ambient;
+    uint32_t generation;        // generation of the map the lightmap is up to date with
+
+    Light* lights;
+    uint32_t light_count, light_capacity;
+
+    uint8_t* cells;
+    uint8_t* faces;
+} Lightmap;
+
+Lightmap* Lightmap_Create( // keeps a reference on the map, the capacity of lights is fixed
+    const Map* map,
+    const float ambient,
+    const uint32_t capacity
+);
+
+int32_t Lightmap_AddLight( // returns the index of the light, or -1 if the lightmap is full
+    Lightmap* lightmap,
+    const float x,
+    const float y,
+    const float radius,
+    const float intensity
+);
+
+void Lightmap_MoveLight(
+    Lightmap* lightmap,
+    const uint32_t id,
+    const float x,
+    const float y
+);
+
+void Lightmap_RemoveLight( // the last light takes the index of the removed one
+    Lightmap* lightmap,
+    const uint32_t id
+);
+
+void Lightmap_UpdateCell( // to call after changing a cell of the map
+    Lightmap* lightmap,
+    const int x,
+    const int y
+);
+
+void Lightmap_UpdateRect( // to call after changing the cells of a rectangle of the map (bounds included)
+    Lightmap* lightmap,
+    const int x0, const int y0,
+    const int x1, const int y1
+);
+
+SDL_bool Lightmap_Sync( // relights the edits of the map since the last sync, returns whether there were any
+    Lightmap* lightmap
+);
+
+void Lightmap_Relight( // bakes the cells of the rectangle again (bounds included)
+    Lightmap* lightmap,
+    int x0, int y0,
+    int x1, int y1
+);
+
+void Lightmap_Destroy(
+    Lightmap* lightmap
+);
+
+#endif
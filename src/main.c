@@ -7,8 +7,10 @@
 
 #include "window.h"
 #include "clock.h"
+#include "light.h"
 #include "map.h"
 #include "raycast.h"
+#include "sprite.h"
 #include "textures.h"
 
 #define WIN_W 640
@@ -39,13 +41,48 @@ int main(void)
         { 255, 127, 255 },
     };
 
-    // Map* map = Map_MazeGen(32, 32, 8, wall_colors);
-    Map* map = Map_RandGen(32, 32, 8, wall_colors);
+    // Map* map = Map_MazeGen(32, 32, 8, wall_colors, time(NULL));
+    Map* map = Map_RandGen(32, 32, 8, wall_colors, time(NULL));
+
+    // Lower some walls to half height, the view goes on above them (optional)
+    for (int i = 0; i < 48; i++)
+        Map_SetHeight(map, rand() % map->width, rand() % map->height, MAP_WALL_HEIGHT / 2);
 
     /* Load raycaster */
 
     // If you load your own textures you can leave the flag at 0.
-    Raycast_Data* raycast = Raycast_Init(renderer, WIN_W, WIN_H, map, 0, 0, AUTO_FLOOR_TEX | AUTO_WALL_TEX); // FLAGS: 0 - COLORED || AUTO_FULL_TEX || AUTO_WALL_TEX || AUTO_FLOOR_TEX || AUTO_CEILING_TEX
+    Raycast_Data* raycast = Raycast_Init(renderer, WIN_W, WIN_H, map, 0, 0, AUTO_FLOOR_TEX | AUTO_WALL_TEX | AUTO_SPRITE_TEX); // FLAGS: 0 - COLORED || AUTO_FULL_TEX || AUTO_WALL_TEX || AUTO_FLOOR_TEX || AUTO_CEILING_TEX || AUTO_SPRITE_TEX
+
+    /* Scatter sprites on the free cells (optional) */
+
+    SpriteSet* sprites = Sprite_CreateSet(map, 256);
+
+    /* Bake the lighting, with a light on each lamp sprite (optional) */
+
+    Lightmap* lightmap = Lightmap_Create(map, .4f, 64);
+
+    for (int i = 0; i < 256; i++) {
+        const int x = 1 + rand() % map->width, y = 1 + rand() % map->height;
+        if (map->data[x][y]) continue;
+
+        const uint16_t tex = rand() % 3;
+        Sprite_Add(sprites, x + .5f, y + .5f, tex);
+        if (tex == 2) Lightmap_AddLight(lightmap, x + .5f, y + .5f, 5.f, .8f); // yellow lamp
+    }
+
+    Sprite_Commit(sprites); // buckets the sprites for the culling
+    Raycast_LoadSprites(raycast, sprites, NULL); // NULL: uses the textures generated by AUTO_SPRITE_TEX
+    Raycast_LoadLightmap(raycast, lightmap);
+
+    // Lower the internal resolution down to half the window if casting exceeds the frame budget (textured mode only)
+    Raycast_SetScaleGovernor(raycast, .5f, 1.f, TPF);
+
+    // Cast the next frame on a render thread while the last one is uploaded and presented (one frame of latency)
+    if (SDL_GetCPUCount() > 1) Raycast_SetPipeline(raycast, SDL_TRUE);
+    else Raycast_SetZeroCopy(raycast, SDL_TRUE); // otherwise cast straight in the render texture
+
+    // Take the mouse motion received until the frame is cast, and measure the input latency (shown with the FPS)
+    Raycast_SetLateLatch(raycast, SDL_TRUE);
 
     /* // Load textures (optional)
 
@@ -81,19 +118,26 @@ int main(void)
             Raycast_GetEvents(raycast, &event);
         }
 
-        Raycast_Update(raycast, &clock);
+        while (Clock_Tick(&clock)) // the simulation runs at TICK_RATE whatever the frame rate
+            Raycast_Update(raycast, &clock);
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-        SDL_RenderClear(renderer);
+        // nothing is cast nor presented while the image would stay the same (standing still, paused...)
+        if (Raycast_NeedsRender(raycast, &clock))
+        {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
 
-        Raycast_Render(raycast, renderer, &clock);
+            Raycast_Render(raycast, renderer, &clock);
 
-        SDL_RenderPresent(renderer);
+            Raycast_Present(raycast, renderer);
+        }
 
         Clock_Limit(&clock);
     }
 
-    Raycast_Free(raycast); // Raycast_Free destroys the textures but not the active map
+    Raycast_Free(raycast); // Raycast_Free releases its references to the textures and the map
+    Sprite_DestroySet(sprites);
+    Lightmap_Destroy(lightmap);
     Map_Destroy(map);
 
     Window_Quit(window, renderer);
@@ -1,12 +1,20 @@
 #include "map.h"
 #include "color.h"
 
+#include <SDL2/SDL_cpuinfo.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_stdinc.h>
+#include <SDL2/SDL_thread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+#define CAVE_CHUNK          64  // side of the square chunks generated independently by the workers
+#define CAVE_FILL           45  // percentage of walls in the initial noise
+#define CAVE_STEPS          4   // smoothing passes of the cellular automaton
+#define CAVE_MIN_REGION     16  // caves smaller than this are filled instead of being connected
+#define CAVE_MAX_THREADS    64
+
 Map* Map_Create(
     const uint16_t width,
     const uint16_t height,
@@ -18,9 +26,13 @@ Map* Map_Create(
 
     Map* map = malloc(sizeof(Map) + size_wall_colors);
 
-    *(int*)&map->width = width;
-    *(int*)&map->height = height;
+    *(uint16_t*)&map->width = width;
+    *(uint16_t*)&map->height = height;
     *(uint8_t*)&map->wall_num = wall_num;
+    SDL_AtomicSet(&map->refs, 1);
+    map->generation = 0;
+    map->heights = NULL;
+    map->floors = map->ceilings = NULL;
 
     memcpy(*(RGB_Array*)map->wall_color, wall_colors, size_wall_colors);
 
@@ -30,7 +42,7 @@ Map* Map_Create(
     if (flags & (MAP_FILL | MAP_RANDWALL))
     {
         for (int x = 0; x <= width; x++)
-            map->data[x] = values + x * height;
+            map->data[x] = values + x * (height+1);
 
         int w_start = 0, w_end = width;
         int h_start = 1, h_end = height-1;
@@ -61,7 +73,7 @@ Map* Map_Create(
     {
         for (int x = 0; x <= width; x++)
         {
-            map->data[x] = values + x * height;
+            map->data[x] = values + x * (height+1);
             for (int y = 0; y <= height; y++)
                 map->data[x][y] = 1;
         }
@@ -69,7 +81,7 @@ Map* Map_Create(
     else
     {
         for (int x = 0; x <= width; x++)
-            map->data[x] = values + x * height;
+            map->data[x] = values + x * (height+1);
 
         for (int x = 0; x <= width; x++)
         {
@@ -87,172 +99,410 @@ Map* Map_Create(
     return map;
 }
 
+void _log_edit(Map* map, const int x0, const int y0, const int x1, const int y1)
+{
+    map->dirty[map->generation % MAP_DIRTY_LOG] = (SDL_Rect){ x0, y0, x1 - x0 + 1, y1 - y0 + 1 };
+    map->generation++;
+}
+
+void Map_SetCell(Map* map, const int x, const int y, const uint8_t value)
+{
+    if (x < 0 || y < 0 || x > map->width || y > map->height || map->data[x][y] == value) return;
+
+    map->data[x][y] = value;
+    _log_edit(map, x, y, x, y);
+}
+
+void Map_FillRect(Map* map, int x0, int y0, int x1, int y1, const uint8_t value)
+{
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > map->width) x1 = map->width;
+    if (y1 > map->height) y1 = map->height;
+    if (x0 > x1 || y0 > y1) return;
+
+    for (int x = x0; x <= x1; x++)
+        memset(&map->data[x][y0], value, y1 - y0 + 1); // the columns are contiguous
+
+    _log_edit(map, x0, y0, x1, y1);
+}
+
+uint8_t** _alloc_layer(const Map* map, const uint8_t value) // one byte per cell, with column pointers like data
+{
+    uint8_t* values = malloc((map->width+1)*(map->height+1));
+    memset(values, value, (map->width+1)*(map->height+1));
+
+    uint8_t** layer = malloc((map->width+1)*sizeof(uint8_t*));
+    for (int x = 0; x <= map->width; x++)
+        layer[x] = values + x * (map->height+1);
+
+    return layer;
+}
+
+void _free_layer(uint8_t** layer)
+{
+    if (!layer) return;
+
+    free(*layer);
+    free(layer);
+}
+
+void Map_SetHeight(Map* map, const int x, const int y, const uint8_t height)
+{
+    if (x <= 0 || y <= 0 || x >= map->width || y >= map->height) return;
+
+    if (!map->heights) { // allocated by the first wall lowered
+        if (height == MAP_WALL_HEIGHT) return;
+        map->heights = _alloc_layer(map, MAP_WALL_HEIGHT);
+    }
+
+    if (map->heights[x][y] == height) return;
+
+    map->heights[x][y] = height;
+    _log_edit(map, x, y, x, y);
+}
+
+void Map_SetMaterial(Map* map, const int x, const int y, const uint8_t floor, const uint8_t ceiling)
+{
+    if (x < 0 || y < 0 || x > map->width || y > map->height) return;
+
+    if (!map->floors) { // allocated by the first material set
+        if (!floor && !ceiling) return;
+        map->floors = _alloc_layer(map, 0);
+        map->ceilings = _alloc_layer(map, 0);
+    }
+
+    if (map->floors[x][y] == floor && map->ceilings[x][y] == ceiling) return;
+
+    map->floors[x][y] = floor;
+    map->ceilings[x][y] = ceiling;
+    _log_edit(map, x, y, x, y);
+}
+
+uint8_t Map_GetHeight(const Map* map, const int x, const int y)
+{
+    return map->heights ? map->heights[x][y] : MAP_WALL_HEIGHT;
+}
+
+SDL_bool Map_GetDirty(const Map* map, const uint32_t generation, SDL_Rect* rect)
+{
+    if (generation == map->generation) return SDL_FALSE;
+
+    if (map->generation - generation > MAP_DIRTY_LOG) {
+        *rect = (SDL_Rect){ 0, 0, map->width + 1, map->height + 1 };
+        return SDL_TRUE;
+    }
+
+    *rect = map->dirty[generation % MAP_DIRTY_LOG];
+
+    for (uint32_t g = generation + 1; g != map->generation; g++)
+        SDL_UnionRect(rect, &map->dirty[g % MAP_DIRTY_LOG], rect);
+
+    return SDL_TRUE;
+}
+
+uint32_t _rand_next(uint64_t* state) // splitmix64, the generators do not touch the global rand()
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (z ^ (z >> 31)) >> 32;
+}
+
+uint8_t* _ring_walls(const Map* map, uint64_t* rng) // random wall type of each concentric ring of the map
+{
+    const int rings = (map->width < map->height ? map->width : map->height) / 2 + 1;
+    uint8_t* ring_wall = malloc(rings);
+
+    for (int i = 0; i < rings; i++)
+        ring_wall[i] = _rand_next(rng) % map->wall_num + 1;
+
+    return ring_wall;
+}
+
+int _ring(const Map* map, const int x, const int y) // distance to the nearest edge of the map
+{
+    int ring = x < y ? x : y;
+    if (map->width - x < ring) ring = map->width - x;
+    if (map->height - y < ring) ring = map->height - y;
+    return ring;
+}
+
+void _fill_rings(Map* map, uint64_t* rng) // fills the whole map with walls, in concentric rings of a random type
+{
+    uint8_t* ring_wall = _ring_walls(map, rng);
+
+    for (int x = 0; x <= map->width; x++)
+        for (int y = 0; y <= map->height; y++)
+            map->data[x][y] = ring_wall[_ring(map, x, y)];
+
+    free(ring_wall);
+}
+
 Map* Map_MazeGen(
     const uint16_t width,
     const uint16_t height,
     const uint8_t wall_num,
-    const RGB_Array wall_colors)
+    const RGB_Array wall_colors,
+    const uint32_t seed)
 {
-    /* TODO NOTE: 
-        This algorithm has been adapted from another of my projects,
-        it would be necessary to rewrite one that will be more suitable.
-    */
+    /* Iterative backtracker: the maze cells are the odd coordinates, each one is carved once and pushed
+       once on the stack, so the time and memory are linear in the number of cells. */
 
-    Map* map = Map_Create(width+1, height+1, wall_num, wall_colors, MAP_FILL | MAP_RANDWALL);
+    Map* map = Map_Create(width+1, height+1, wall_num, wall_colors, 0);
 
-    uint16_t pos_x = 1, pos_y = 1;
-    map->data[pos_x][pos_y] = 255;
+    uint64_t rng = seed;
+    _fill_rings(map, &rng);
 
-    uint8_t dir;
-    SDL_bool not_pass;
-    uint8_t wall_type;
+    const uint32_t cells = ((width+1)/2) * ((height+1)/2);
+    if (!cells) return map;
 
-    do {
+    uint32_t* stack = malloc(sizeof(uint32_t) * cells); // cells as x | y << 16
+    uint32_t top = 0;
 
-        dir = rand() % 4;
+    map->data[1][1] = 0;
+    stack[top++] = 1 | 1 << 16;
 
-        for (int i=1; i<=wall_num; i++) {
-            if ((pos_x+2 < width && map->data[pos_x+2][pos_y] == i)
-            || (pos_x-2 > 0 && map->data[pos_x-2][pos_y] == i)
-            || (pos_y+2 < height && map->data[pos_x][pos_y+2] == i)
-            || (pos_y-2 > 0 && map->data[pos_x][pos_y-2] == i)) {
-                not_pass = SDL_TRUE; wall_type = i; break;
-            } else not_pass = SDL_FALSE;
-        }
+    while (top)
+    {
+        const uint16_t x = stack[top-1] & 0xFFFF;
+        const uint16_t y = stack[top-1] >> 16;
+
+        int8_t dirs[4][2]; uint8_t n = 0;
 
-        if (not_pass)
+        if (x > 1 && map->data[x-2][y]) dirs[n][0] = -1, dirs[n++][1] = 0;
+        if (x+2 <= width && map->data[x+2][y]) dirs[n][0] = 1, dirs[n++][1] = 0;
+        if (y > 1 && map->data[x][y-2]) dirs[n][0] = 0, dirs[n++][1] = -1;
+        if (y+2 <= height && map->data[x][y+2]) dirs[n][0] = 0, dirs[n++][1] = 1;
+
+        if (!n) { top--; continue; } // dead end, back to the previous cell
+
+        const int8_t* dir = dirs[n > 1 ? _rand_next(&rng) % n : 0];
+        const uint16_t nx = x + 2*dir[0], ny = y + 2*dir[1];
+
+        map->data[x+dir[0]][y+dir[1]] = 0;
+        map->data[nx][ny] = 0;
+        stack[top++] = nx | (uint32_t)ny << 16;
+    }
+
+    free(stack);
+
+    return map;
+}
+
+/* Caves: noise smoothed by a cellular automaton. The noise of a cell only depends on the seed and its position, and
+   after CAVE_STEPS passes a cell only depends on the noise up to CAVE_STEPS cells around it, so each chunk is built
+   alone from its own margin and the workers never wait for each other. The result does not depend on the chunking. */
+
+struct _Map_Caves {
+    Map* map;
+    const uint8_t* ring_wall;
+    uint32_t seed;
+    uint16_t chunks_x, chunks_y;
+    SDL_atomic_t next;      // index of the next chunk to generate, shared by the workers
+};
+
+SDL_bool _cave_noise(const Map* map, const uint32_t seed, const int x, const int y)
+{
+    if (x <= 0 || y <= 0 || x >= map->width || y >= map->height) return SDL_TRUE; // the edges are always walls
+
+    uint64_t state = ((uint64_t)seed << 32 | (uint32_t)x << 16 | y) * 0xD1B54A32D192ED03ull;
+    return _rand_next(&state) % 100 < CAVE_FILL;
+}
+
+int _cave_worker(void* data)
+{
+    struct _Map_Caves* caves = data;
+    Map* map = caves->map;
+
+    const int side = CAVE_CHUNK + 2 * CAVE_STEPS;
+    uint8_t* cells[2] = { malloc(side * side), malloc(side * side) };
+
+    for (;;)
+    {
+        const int chunk = SDL_AtomicAdd(&caves->next, 1);
+        if (chunk >= caves->chunks_x * caves->chunks_y) break;
+
+        const int x0 = (chunk % caves->chunks_x) * CAVE_CHUNK - CAVE_STEPS;
+        const int y0 = (chunk / caves->chunks_x) * CAVE_CHUNK - CAVE_STEPS;
+
+        for (int lx = 0; lx < side; lx++)
+            for (int ly = 0; ly < side; ly++)
+                cells[0][lx*side + ly] = _cave_noise(map, caves->seed, x0 + lx, y0 + ly);
+
+        /* Each pass is valid one cell less far into the margin: a cell becomes a wall with 5 walls or more
+           among the 9 of its neighbourhood, itself included */
+
+        for (int step = 1; step <= CAVE_STEPS; step++)
         {
-            switch(dir)
-            {
-                case 0:
-                    if (pos_x+2 < width && map->data[pos_x+2][pos_y] == wall_type) {
-                        pos_x = pos_x+2;
-                        map->data[pos_x][pos_y] = 254;
-                        map->data[pos_x-1][pos_y] = 254;
-                    } break;
-
-                case 1:
-                    if (pos_x-2 > 0 && map->data[pos_x-2][pos_y] == wall_type) {
-                        pos_x = pos_x-2;
-                        map->data[pos_x][pos_y] = 254;
-                        map->data[pos_x+1][pos_y] = 254;
-                    } break;
-
-                case 2:
-                    if (pos_y+2 < height && map->data[pos_x][pos_y+2] == wall_type) {
-                        pos_y = pos_y+2;
-                        map->data[pos_x][pos_y] = 254;
-                        map->data[pos_x][pos_y-1] = 254;
-                    } break;
-
-                case 3:
-                    if (pos_y-2 > 0 && map->data[pos_x][pos_y-2] == wall_type) {
-                        pos_y = pos_y-2;
-                        map->data[pos_x][pos_y] = 254;
-                        map->data[pos_x][pos_y+1] = 254;
-                    } break;
-
-                default:
-                    break;
-            }
+            const uint8_t* src = cells[(step-1) & 1];
+            uint8_t* dst = cells[step & 1];
+
+            for (int lx = step; lx < side - step; lx++)
+                for (int ly = step; ly < side - step; ly++)
+                {
+                    const int x = x0 + lx, y = y0 + ly;
 
+                    if (x <= 0 || y <= 0 || x >= map->width || y >= map->height) {
+                        dst[lx*side + ly] = 1;
+                        continue;
+                    }
+
+                    const uint8_t* c = src + lx*side + ly;
+                    const int walls = c[-side-1] + c[-side] + c[-side+1]
+                                    + c[-1]      + c[0]     + c[1]
+                                    + c[side-1]  + c[side]  + c[side+1];
+
+                    dst[lx*side + ly] = walls >= 5;
+                }
         }
-        else if (map->data[pos_x+1][pos_y] == 254
-              || map->data[pos_x-1][pos_y] == 254
-              || map->data[pos_x][pos_y+1] == 254
-              || map->data[pos_x][pos_y-1] == 254)
+
+        const uint8_t* result = cells[CAVE_STEPS & 1];
+
+        for (int lx = CAVE_STEPS; lx < side - CAVE_STEPS; lx++)
         {
-            map->data[pos_x][pos_y] = 0;
+            const int x = x0 + lx;
+            if (x > map->width) break;
 
-            switch (dir)
+            for (int ly = CAVE_STEPS; ly < side - CAVE_STEPS; ly++)
             {
-                case 0:
-                    if (map->data[pos_x+1][pos_y] == 254) {
-                        pos_x = pos_x+2;
-                        map->data[pos_x][pos_y] = 0;
-                        map->data[pos_x-1][pos_y] = 0;
-                    } break;
-
-                case 1:
-                    if (map->data[pos_x-1][pos_y] == 254) {
-                        pos_x = pos_x-2;
-                        map->data[pos_x][pos_y] = 0;
-                        map->data[pos_x+1][pos_y] = 0;
-                    } break;
-
-                case 2:
-                    if (map->data[pos_x][pos_y+1] == 254) {
-                        pos_y = pos_y+2;
-                        map->data[pos_x][pos_y] = 0;
-                        map->data[pos_x][pos_y-1] = 0;
-                    } break;
-
-                case 3:
-                    if (map->data[pos_x][pos_y-1] == 254) {
-                        pos_y = pos_y-2;
-                        map->data[pos_x][pos_y] = 0;
-                        map->data[pos_x][pos_y+1] = 0;
-                    } break;
-
-                default:
-                    break;
+                const int y = y0 + ly;
+                if (y > map->height) break;
+
+                map->data[x][y] = result[lx*side + ly] ? caves->ring_wall[_ring(map, x, y)] : 0;
             }
         }
+    }
+
+    free(cells[0]);
+    free(cells[1]);
+
+    return 0;
+}
+
+void _connect_caves(Map* map, const uint8_t* ring_wall)
+{
+    /* The caves are flood filled in the order of the chunks, in a serpentine, so that two caves found one after the
+       other are close. The small ones are filled, each other one is joined to the previous by a corridor. */
+
+    const uint32_t stride = map->height + 1;
+    uint32_t* visited = calloc((((map->width + 1) * stride) + 31) / 32, sizeof(uint32_t));
+
+    uint32_t queue_capacity = 1024, rep_count = 0, rep_capacity = 64;
+    uint32_t* queue = malloc(sizeof(uint32_t) * queue_capacity);   // cells of the current cave, as x | y << 16
+    uint32_t* reps = malloc(sizeof(uint32_t) * rep_capacity);      // first cell of each cave kept
+
+    const int chunks_x = (map->width + CAVE_CHUNK - 1) / CAVE_CHUNK;
+    const int chunks_y = (map->height + CAVE_CHUNK - 1) / CAVE_CHUNK;
+
+    for (int cx = 0; cx < chunks_x; cx++)
+        for (int i = 0; i < chunks_y; i++)
+        {
+            const int cy = cx & 1 ? chunks_y - 1 - i : i;
+
+            for (int x = 1 + cx * CAVE_CHUNK; x < 1 + (cx+1) * CAVE_CHUNK && x < map->width; x++)
+                for (int y = 1 + cy * CAVE_CHUNK; y < 1 + (cy+1) * CAVE_CHUNK && y < map->height; y++)
+                {
+                    if (map->data[x][y] || visited[(x*stride + y) >> 5] & 1u << ((x*stride + y) & 31)) continue;
+
+                    uint32_t head = 0, tail = 0;
+                    queue[tail++] = x | (uint32_t)y << 16;
+                    visited[(x*stride + y) >> 5] |= 1u << ((x*stride + y) & 31);
+
+                    while (head < tail)
+                    {
+                        const int qx = queue[head] & 0xFFFF, qy = queue[head] >> 16;
+                        head++;
+
+                        const int next[4][2] = { {qx-1, qy}, {qx+1, qy}, {qx, qy-1}, {qx, qy+1} };
+
+                        for (int n = 0; n < 4; n++)
+                        {
+                            const int nx = next[n][0], ny = next[n][1];
+                            const uint32_t bit = nx*stride + ny;
+
+                            if (map->data[nx][ny] || visited[bit >> 5] & 1u << (bit & 31)) continue;
+                            visited[bit >> 5] |= 1u << (bit & 31);
+
+                            if (tail == queue_capacity) {
+                                queue_capacity *= 2;
+                                queue = realloc(queue, sizeof(uint32_t) * queue_capacity);
+                            }
+
+                            queue[tail++] = nx | (uint32_t)ny << 16;
+                        }
+                    }
+
+                    if (tail < CAVE_MIN_REGION && rep_count) // the first cave holds (1, 1), it is always kept
+                    {
+                        for (uint32_t c = 0; c < tail; c++) {
+                            const int qx = queue[c] & 0xFFFF, qy = queue[c] >> 16;
+                            map->data[qx][qy] = ring_wall[_ring(map, qx, qy)];
+                        }
+                        continue;
+                    }
+
+                    if (rep_count == rep_capacity) {
+                        rep_capacity *= 2;
+                        reps = realloc(reps, sizeof(uint32_t) * rep_capacity);
+                    }
+
+                    reps[rep_count++] = queue[0];
+                }
+        }
 
-    } while (map->data[1][1] != 0);
+    /* L-shaped corridors, carved once all the caves are known so they can't be filled */
 
-    return map;
+    for (uint32_t i = 1; i < rep_count; i++)
+    {
+        const int x0 = reps[i-1] & 0xFFFF, y0 = reps[i-1] >> 16;
+        const int x1 = reps[i] & 0xFFFF, y1 = reps[i] >> 16;
+
+        for (int x = x0; x != x1; x += x1 > x0 ? 1 : -1) map->data[x][y0] = 0;
+        for (int y = y0; y != y1; y += y1 > y0 ? 1 : -1) map->data[x1][y] = 0;
+    }
+
+    free(visited);
+    free(queue);
+    free(reps);
 }
 
 Map* Map_RandGen(
     const uint16_t width,
     const uint16_t height,
     const uint8_t wall_num,
-    const RGB_Array wall_colors)
+    const RGB_Array wall_colors,
+    const uint32_t seed)
 {
-    Map* map = Map_Create(width+1, height+1, wall_num, wall_colors, MAP_FILL | MAP_RANDWALL);
+    Map* map = Map_Create(width+1, height+1, wall_num, wall_colors, 0);
 
-    uint16_t pos_x = 1, pos_y = 1;
-    uint16_t prev_pos_x = pos_x;
-    uint16_t prev_pos_y = pos_y;
-    uint8_t dir; uint16_t mov;
+    uint64_t rng = seed;
+    uint8_t* ring_wall = _ring_walls(map, &rng);
 
-    while (map->data[width][height] != 0)
-    {
-        map->data[pos_x][pos_y] = 0;
+    struct _Map_Caves caves = { map, ring_wall, seed, 0, 0, { 0 } };
+    caves.chunks_x = (map->width + CAVE_CHUNK) / CAVE_CHUNK;
+    caves.chunks_y = (map->height + CAVE_CHUNK) / CAVE_CHUNK;
 
-        do {
+    /* The calling thread works too, so only the additional workers are created */
 
-            dir = rand() % 4;
+    unsigned workers = caves.chunks_x * caves.chunks_y;
+    if (workers > (unsigned)SDL_GetCPUCount()) workers = SDL_GetCPUCount();
+    if (workers > CAVE_MAX_THREADS) workers = CAVE_MAX_THREADS;
 
-            switch(dir)
-            {
-                case 0: // West
-                    mov = pos_x - 1;
-                    if (mov > 0)
-                        pos_x = mov;
-                    break;
-                case 1: // East
-                    mov = pos_x + 1;
-                    if (mov <= width)
-                        pos_x = mov;
-                    break;
-                case 2: // North
-                    mov = pos_y - 1;
-                    if (mov > 0)
-                        pos_y = mov;
-                    break;
-                case 3: // South
-                    mov = pos_y + 1;
-                    if (mov <= width)
-                        pos_y = mov;
-                    break;
-            }
+    SDL_Thread* threads[CAVE_MAX_THREADS];
 
-        } while(pos_x == prev_pos_x && pos_y == prev_pos_y);
+    for (unsigned i = 1; i < workers; i++)
+        threads[i] = SDL_CreateThread(_cave_worker, "map_caves", &caves);
 
-        prev_pos_x = pos_x, prev_pos_y = pos_y;
-    }
+    _cave_worker(&caves);
+
+    for (unsigned i = 1; i < workers; i++)
+        SDL_WaitThread(threads[i], NULL);
+
+    map->data[1][1] = 0; // start of the player
+    _connect_caves(map, ring_wall);
+
+    free(ring_wall);
 
     return map;
 }
@@ -296,9 +546,21 @@ void Map_Render(
     );
 }
 
+Map* Map_Retain(Map* map)
+{
+    SDL_AtomicIncRef(&map->refs);
+    return map;
+}
+
 void Map_Destroy(Map* map)
 {
+    if (!SDL_AtomicDecRef(&map->refs)) return;
+
     free(*map->data);
     free(map->data);
+
+    _free_layer(map->heights);
+    _free_layer(map->floors);
+    _free_layer(map->ceilings);
     free(map);
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef _MAP_H_
 #define _MAP_H_
 
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_pixels.h>
+#include <SDL2/SDL_rect.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_stdinc.h>
 #include <stdint.h>
@@ -11,14 +13,27 @@
 #define MAP_FILL     0x01
 #define MAP_RANDWALL 0x02
 
+#define MAP_WALL_HEIGHT 255  // height of a full wall, from the floor to the ceiling
+#define MAP_DIRTY_LOG 64    // edits remembered by a map, a consumer later than that rebuilds everything
+
 typedef struct {
     uint8_t** data;
+    uint8_t** heights;  // height of the wall of each cell, NULL while every wall is full height (see Map_SetHeight)
+    uint8_t** floors;   // floor and ceiling materials of each cell, NULL while none is set (see Map_SetMaterial)
+    uint8_t** ceilings;
     const uint16_t width;
     const uint16_t height;
     const uint8_t wall_num;
+    SDL_atomic_t refs;  // maps can be shared by several raycasters, see Map_Retain and Map_Destroy
+    uint32_t generation;            // number of edits made with Map_SetCell and Map_FillRect
+    SDL_Rect dirty[MAP_DIRTY_LOG];  // ring of the rectangles of the last edits, the edit n is at n % MAP_DIRTY_LOG
     const RGB_Array wall_color;
 } Map;
 
+// Editing: the cells changed by Map_SetCell and Map_FillRect are logged, so that the structures derived from the map
+// (minimap, lightmap, ...) only update what changed. A consumer keeps the generation it is up to date with and
+// asks for the area edited since then with Map_GetDirty. Writing map->data directly is not tracked.
+
 Map* Map_Create(
     const uint16_t width,
     const uint16_t height,
@@ -27,18 +42,61 @@ Map* Map_Create(
     const uint8_t flags
 );
 
-Map* Map_MazeGen(
+void Map_SetCell(
+    Map* map,
+    const int x,
+    const int y,
+    const uint8_t value
+);
+
+void Map_FillRect( // bounds included, clamped to the map
+    Map* map,
+    int x0, int y0,
+    int x1, int y1,
+    const uint8_t value
+);
+
+void Map_SetHeight( // the view goes on above the walls lower than MAP_WALL_HEIGHT, the edges of the map stay full height
+    Map* map,
+    const int x,
+    const int y,
+    const uint8_t height
+);
+
+void Map_SetMaterial( // 0 is the floor or ceiling texture of the raycaster, n the texture n-1 of its materials (see Raycast_LoadMaterials)
+    Map* map,
+    const int x,
+    const int y,
+    const uint8_t floor,
+    const uint8_t ceiling
+);
+
+uint8_t Map_GetHeight(
+    const Map* map,
+    const int x,
+    const int y
+);
+
+SDL_bool Map_GetDirty( // bounding rectangle of the edits since the generation, the whole map if they are no longer logged
+    const Map* map,
+    const uint32_t generation,
+    SDL_Rect* rect
+);
+
+Map* Map_MazeGen( // perfect maze in linear time, the same seed gives the same maze
     const uint16_t width,
     const uint16_t height,
     const uint8_t wall_num,
-    const RGB_Array wall_colors
+    const RGB_Array wall_colors,
+    const uint32_t seed
 );
 
-Map* Map_RandGen(
+Map* Map_RandGen( // connected caves in linear time, generated by chunks on all the CPU cores, the same seed gives the same map
     const uint16_t width,
     const uint16_t height,
     const uint8_t wall_num,
-    const RGB_Array wall_colors
+    const RGB_Array wall_colors,
+    const uint32_t seed
 );
 
 void Map_Render(
@@ -50,6 +108,8 @@ void Map_Render(
     const SDL_bool show_grid
 );
 
-void Map_Destroy(Map* map);
+Map* Map_Retain(Map* map);
+
+void Map_Destroy(Map* map); // releases one reference, the map is freed with the last one
 
 #endif
\ No newline at end of file
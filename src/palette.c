@@ -0,0 +1,170 @@
+#include "palette.h"
+
+#include <SDL2/SDL_atomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "textures.h"
+
+uint8_t _nearest_color(const Palette* palette, const int r, const int g, const int b) // the first of the nearest colors
+{
+    uint8_t nearest = 0;
+    int nearest_dist = INT32_MAX;
+
+    for (int i = 0; i < 256; i++)
+    {
+        const int dr = (int)(palette->colors[i] >> 16 & 0xFF) - r;
+        const int dg = (int)(palette->colors[i] >> 8 & 0xFF) - g;
+        const int db = (int)(palette->colors[i] & 0xFF) - b;
+
+        // weighted for the sensitivity of the eye to each channel
+        const int dist = 3 * dr * dr + 4 * dg * dg + 2 * db * db;
+
+        if (dist < nearest_dist) {
+            nearest = i, nearest_dist = dist;
+            if (dist == 0) break;
+        }
+    }
+
+    return nearest;
+}
+
+Palette* Palette_Create(const Pixel* colors, const unsigned count)
+{
+    Palette* palette = malloc(sizeof(Palette));
+
+    memset(palette->colors, 0, sizeof(palette->colors));
+    memcpy(palette->colors, colors, (count < 256 ? count : 256) * sizeof(Pixel));
+    palette->colors[0] = 0x000000;
+
+    for (int i = 0; i < 256; i++)
+        palette->colors[i] &= 0x00FFFFFF;
+
+    /* Inverse table, each 5 bits channel is expanded back to 8 bits so that black and white stay exact */
+
+    for (int c = 0; c < 32768; c++)
+    {
+        const int r = c >> 10 & 31, g = c >> 5 & 31, b = c & 31;
+        palette->inverse[c] = _nearest_color(palette, r << 3 | r >> 2, g << 3 | g >> 2, b << 3 | b >> 2);
+    }
+
+    /* Colormaps, each level is darker by 1/PALETTE_SHADES of the full brightness */
+
+    for (int level = 0; level < PALETTE_SHADES; level++)
+    {
+        const int light = PALETTE_SHADES - level;
+
+        for (int i = 0; i < 256; i++)
+        {
+            const Pixel color = palette->colors[i];
+            const Pixel r = (color >> 16 & 0xFF) * light / PALETTE_SHADES;
+            const Pixel g = (color >> 8 & 0xFF) * light / PALETTE_SHADES;
+            const Pixel b = (color & 0xFF) * light / PALETTE_SHADES;
+            palette->colormap[level][i] = Palette_Nearest(palette, r << 16 | g << 8 | b);
+        }
+    }
+
+    static SDL_atomic_t last_id; // 0 is left to the textures not converted
+
+    palette->id = SDL_AtomicAdd(&last_id, 1) + 1;
+    SDL_AtomicSet(&palette->refs, 1);
+
+    return palette;
+}
+
+Palette* Palette_Default(void)
+{
+    Pixel colors[256];
+
+    for (int i = 0; i < 256; i++)
+    {
+        const int r = i >> 5 & 7, g = i >> 2 & 7, b = i & 3;
+        colors[i] = (r * 255 / 7) << 16 | (g * 255 / 7) << 8 | (b * 255 / 3);
+    }
+
+    return Palette_Create(colors, 256);
+}
+
+uint8_t Palette_Nearest(const Palette* palette, const Pixel color)
+{
+    return palette->inverse[(color >> 9 & 0x7C00) | (color >> 6 & 0x03E0) | (color >> 3 & 0x001F)];
+}
+
+uint8_t* _convert_pixels(const Palette* palette, const Pixel* pixels, const uint32_t size)
+{
+    uint8_t* indices = malloc(size);
+
+    for (uint32_t i = 0; i < size; i++)
+        indices[i] = Palette_Nearest(palette, pixels[i]);
+
+    return indices;
+}
+
+Texture* Palette_ConvertTexture(const Palette* palette, Texture* tex)
+{
+    if (tex->indices && tex->palette_id == palette->id) return tex;
+
+    // a shared texture may be drawn by other raycasters meanwhile, the indices for this palette go to a copy
+    if (SDL_AtomicGet(&tex->refs) > 1)
+    {
+        Texture* copy = malloc(sizeof(Texture));
+        copy->w = tex->w, copy->h = tex->h;
+        copy->pixels = NULL;
+        copy->indices = _convert_pixels(palette, tex->pixels, tex->w * tex->h);
+        copy->palette_id = palette->id;
+        SDL_AtomicSet(&copy->refs, 1);
+
+        Texture_Free(tex);
+        return copy;
+    }
+
+    free(tex->indices);
+    tex->indices = _convert_pixels(palette, tex->pixels, tex->w * tex->h);
+    tex->palette_id = palette->id;
+
+    return tex;
+}
+
+TexGroup* Palette_ConvertTexGroup(const Palette* palette, TexGroup* tex_grp)
+{
+    if (tex_grp->indices && tex_grp->palette_id == palette->id) return tex_grp;
+
+    TexGroup* group = tex_grp;
+
+    if (SDL_AtomicGet(&tex_grp->refs) > 1)
+    {
+        group = malloc(sizeof(TexGroup));
+        group->length = tex_grp->length;
+        group->w = tex_grp->w, group->h = tex_grp->h;
+        group->pixels = NULL;
+        group->indices = NULL;
+        SDL_AtomicSet(&group->refs, 1);
+    }
+    else if (group->indices) {
+        for (int i = 0; i < group->length; i++) free(group->indices[i]);
+        free(group->indices);
+    }
+
+    group->indices = malloc(sizeof(*group->indices) * group->length);
+
+    for (int i = 0; i < group->length; i++)
+        group->indices[i] = _convert_pixels(palette, tex_grp->pixels[i], tex_grp->w * tex_grp->h);
+
+    group->palette_id = palette->id;
+
+    if (group != tex_grp) TexGroup_Destroy(tex_grp);
+    return group;
+}
+
+Palette* Palette_Retain(Palette* palette)
+{
+    SDL_AtomicIncRef(&palette->refs);
+    return palette;
+}
+
+void Palette_Free(Palette* palette)
+{
+    if (!SDL_AtomicDecRef(&palette->refs)) return;
+    free(palette);
+}
@@ -0,0 +1,54 @@
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+#include <SDL2/SDL_atomic.h>
+#include <stdint.h>
+
+#include "textures.h"
+
+#define PALETTE_SHADES 32       // light levels of the colormaps, 0 is full bright and the last one is near black
+
+// A palette of 256 colors, the index 0 is black (transparent for the sprites).
+// colormap[level][index] gives the index of the color darkened to this level, so shading
+// an indexed texel costs a single table lookup. Palettes are reference counted like the textures.
+
+typedef struct {
+    Pixel colors[256];
+    uint8_t colormap[PALETTE_SHADES][256];
+    uint8_t inverse[32768];     // nearest index of each color reduced to 5 bits per channel
+    uint32_t id;                // unique, the textures converted to the palette are keyed by it
+    SDL_atomic_t refs;
+} Palette;
+
+Palette* Palette_Create( // the colors after count are black
+    const Pixel* colors,
+    const unsigned count
+);
+
+Palette* Palette_Default( // 3-3-2 bits RGB cube
+    void
+);
+
+uint8_t Palette_Nearest(
+    const Palette* palette,
+    const Pixel color
+);
+
+// The conversions take over the reference given and return one of a texture indexed for the palette: the same texture
+// if nothing else holds it (its 32 bits pixels are kept), else a copy with only the indices, so that the raycasters
+// sharing a texture never see it change. A texture already converted to the palette is returned as is.
+
+Texture* Palette_ConvertTexture(
+    const Palette* palette,
+    Texture* tex
+);
+
+TexGroup* Palette_ConvertTexGroup(
+    const Palette* palette,
+    TexGroup* tex_grp
+);
+
+Palette* Palette_Retain(Palette* palette);
+void Palette_Free(Palette* palette); // releases one reference
+
+#endif
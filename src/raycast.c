@@ -4,12 +4,17 @@
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_stdinc.h>
 #include <SDL2/SDL_scancode.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_ttf.h>
 
 #include <stdint.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "clock.h"
 #include "color.h"
 #include "map.h"
@@ -18,12 +23,33 @@
 
 #include <time.h>
 
+#define RENDER_SCALE_STEPS      32  // granularity of the internal resolution (1/32 of the window)
+#define RENDER_SCALE_COOLDOWN   30  // frames left to the average to settle after a resolution change
+
+#define REPROJECT_TOLERANCE     .04f    // relative depth difference under which a reprojected pixel still shows the same surface
+#define REPROJECT_EDGE          48      // summed channel difference of the cast neighbours above which a moved pixel is reprojected
+
+#define JUMP_SPEED              4.59f   // phase of the jump arc in radians per second
+#define JUMP_HEIGHT             392.f   // top of the jump in screen pixels (for a wall at distance 1)
+
+#define MOUSE_TURN              .0083f  // radians the camera turns per unit of relative mouse motion
+#define MOUSE_PITCH             3.33f   // screen pixels the horizon moves per unit of relative mouse motion
+#define MAX_PITCH               200.f
+
+#define LOW_WALL_LAYERS         8   // low walls kept per column for the sprites, the farther ones share the last layer
+
+#define BATCH_CHUNK             4   // poses taken at once by a batch worker
+#define BATCH_MAX_THREADS       64  // workers of a batch pool, the calling thread included
+
+#define FPS_TEXT_SIZE           32  // bytes of the frame rate and input latency string
+
 /* PRIVATE FUNCTIONS */
 
 SDL_bool _autotex_generation(
     Texture** floor_tex,
     Texture** ceiling_tex,
     TexGroup** wall_tex,
+    TexGroup** sprite_tex,
     uint8_t flags)
 {
     SDL_bool tex_generate = SDL_FALSE;
@@ -32,6 +58,9 @@ SDL_bool _autotex_generation(
     {
         *floor_tex = malloc(sizeof(Texture));
         (*floor_tex)->w = 64, (*floor_tex)->h = 64;
+        SDL_AtomicSet(&(*floor_tex)->refs, 1);
+        (*floor_tex)->indices = NULL;
+        (*floor_tex)->palette_id = 0;
 
         (*floor_tex)->pixels = malloc(sizeof(Pixel) * (*floor_tex)->w * (*floor_tex)->h);
 
@@ -47,6 +76,9 @@ SDL_bool _autotex_generation(
     {
         *ceiling_tex = malloc(sizeof(Texture));
         (*ceiling_tex)->w = 64, (*ceiling_tex)->h = 64;
+        SDL_AtomicSet(&(*ceiling_tex)->refs, 1);
+        (*ceiling_tex)->indices = NULL;
+        (*ceiling_tex)->palette_id = 0;
 
         (*ceiling_tex)->pixels = malloc(sizeof(Pixel) * (*ceiling_tex)->w * (*ceiling_tex)->h);
 
@@ -63,6 +95,9 @@ SDL_bool _autotex_generation(
 
         (*wall_tex)->length = 10;
         (*wall_tex)->w = 64, (*wall_tex)->h = 64;
+        SDL_AtomicSet(&(*wall_tex)->refs, 1);
+        (*wall_tex)->indices = NULL;
+        (*wall_tex)->palette_id = 0;
 
         (*wall_tex)->pixels = malloc(sizeof(*(*wall_tex)->pixels) * (*wall_tex)->length);
 
@@ -90,6 +125,34 @@ SDL_bool _autotex_generation(
         tex_generate = SDL_TRUE;
     }
 
+    if (flags & (AUTO_SPRITE_TEX | AUTO_FULL_TEX))
+    {
+        *sprite_tex = malloc(sizeof(TexGroup));
+
+        (*sprite_tex)->length = 3;
+        (*sprite_tex)->w = 64, (*sprite_tex)->h = 64;
+        SDL_AtomicSet(&(*sprite_tex)->refs, 1);
+        (*sprite_tex)->indices = NULL;
+        (*sprite_tex)->palette_id = 0;
+
+        (*sprite_tex)->pixels = malloc(sizeof(*(*sprite_tex)->pixels) * (*sprite_tex)->length);
+
+        for (unsigned i = 0; i < (*sprite_tex)->length; ++i) {
+            (*sprite_tex)->pixels[i] = malloc(sizeof((*sprite_tex)->pixels[0]) * (*sprite_tex)->w * (*sprite_tex)->h);
+        }
+
+        for(int x = 0; x < (*sprite_tex)->w; x++) for(int y = 0; y < (*sprite_tex)->h; y++) // black texels are transparent
+        {
+            const int dx = x - 32, dy = y - 44, ax = abs(x - 32), ay = abs(y - 20);
+            const int y_c = YGRADIENT(y,(*sprite_tex)->h);
+            (*sprite_tex)->pixels[0][y * (*sprite_tex)->w + x] = (ax < 8) * ((128 + y_c / 2) * 65793);                     // grey pillar
+            (*sprite_tex)->pixels[1][y * (*sprite_tex)->w + x] = (dx * dx + dy * dy < 400) * (65536 * (255 - y_c / 2) + 32); // red ball
+            (*sprite_tex)->pixels[2][y * (*sprite_tex)->w + x] = (ax + ay < 14) * (65536 * 255 + 256 * (255 - 8 * ay));      // yellow lamp
+        }
+
+        tex_generate = SDL_TRUE;
+    }
+
     return tex_generate;
 }
 
@@ -97,9 +160,9 @@ SDL_bool _autotex_generation(
 
 void _update_player_movement(Raycast_Data* raycast, const Clock* clock)
 {
-    /* Adjust the speed according to delta time to keep a constant movement */
+    /* Adjust the speed according to the simulation step to keep a constant movement */
 
-    const float mov_speed = !raycast->ctrl.crouch ? 5.f * clock->delta : 2.5f * clock->delta; // we go half as fast if we are crouched
+    const float mov_speed = !raycast->ctrl.crouch ? 5.f * clock->step : 2.5f * clock->step; // we go half as fast if we are crouched
 
     /* Get direction taking into account speed when moving diagonally */
 
@@ -143,8 +206,11 @@ void _update_player_movement(Raycast_Data* raycast, const Clock* clock)
 
     if(raycast->ctrl.jump)
     {
-        raycast->jump_phase += 0.0765f;                        // += speed
-        raycast->pos_z += cosf(raycast->jump_phase) * 30;   // cos * height
+        const float old_phase = raycast->jump_phase;
+        raycast->jump_phase += JUMP_SPEED * clock->step;
+
+        // the height follows a sine arc, so the jump is the same whatever the tick rate
+        raycast->pos_z += JUMP_HEIGHT * (sinf(raycast->jump_phase) - sinf(old_phase));
 
         if (raycast->pos_z < 0) {
             raycast->ctrl.jump = SDL_FALSE;
@@ -166,74 +232,316 @@ void _update_player_movement(Raycast_Data* raycast, const Clock* clock)
     }
 }
 
-void _update_player_camera(Raycast_Data* raycast, const Clock* clock)
+void _turn_camera(Raycast_Data* raycast, const int32_t dx, const int32_t dy)
 {
-    /* Checking camera movements with the mouse */
+    if (dx)
+    {
+        const float rot = -dx * MOUSE_TURN; // to the left for a negative motion
+        const float c = cosf(rot), s = sinf(rot);
+
+        const float old_dir_x = raycast->dir_x;
+        raycast->dir_x = raycast->dir_x * c - raycast->dir_y * s;
+        raycast->dir_y = old_dir_x * s + raycast->dir_y * c;
+
+        const float old_plane_x = raycast->plane_x;
+        raycast->plane_x = raycast->plane_x * c - raycast->plane_y * s;
+        raycast->plane_y = old_plane_x * s + raycast->plane_y * c;
+    }
 
-    float old_dir_x, old_plane_x;
+    if (dy) raycast->pitch = fmaxf(-MAX_PITCH, fminf(MAX_PITCH, raycast->pitch - dy * MOUSE_PITCH)); // up for a negative motion
+}
 
-    if (raycast->ctrl.mouse_mx)
+uint32_t _latch_camera(Raycast_Data* raycast) // turns the camera with the mouse motion received up to now, returns the time of the oldest one
+{
+    if (raycast->late_latch)
     {
-        raycast->ctrl.mouse_mx = SDL_FALSE;
+        // the motion still queued is taken now rather than at the next SDL_PollEvent of the caller
+        SDL_Event events[16];
+        int count;
 
-        const float rot_speed = .5f * abs(raycast->ctrl.mouse_dx) * clock->delta;
+        SDL_PumpEvents();
+        while ((count = SDL_PeepEvents(events, 16, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION)) > 0)
+            for (int i = 0; i < count; i++) Raycast_GetEvents(raycast, &events[i]);
+    }
 
-        if (raycast->ctrl.mouse_dx < 0) // Look to left
-        {
-            old_dir_x = raycast->dir_x;
-            raycast->dir_x = raycast->dir_x * cos(rot_speed) - raycast->dir_y * sin(rot_speed);
-            raycast->dir_y = old_dir_x * sin(rot_speed) + raycast->dir_y * cos(rot_speed);
+    _turn_camera(raycast, raycast->ctrl.mouse_dx, raycast->ctrl.mouse_dy);
 
-            old_plane_x = raycast->plane_x;
-            raycast->plane_x = raycast->plane_x * cos(rot_speed) - raycast->plane_y * sin(rot_speed);
-            raycast->plane_y = old_plane_x * sin(rot_speed) + raycast->plane_y * cos(rot_speed);
-        }
-        else if (raycast->ctrl.mouse_dx > 0) // Look to right
-        {
-            old_dir_x = raycast->dir_x;
-            raycast->dir_x = raycast->dir_x * cos(-rot_speed) - raycast->dir_y * sin(-rot_speed);
-            raycast->dir_y = old_dir_x * sin(-rot_speed) + raycast->dir_y * cos(-rot_speed);
+    raycast->latch_dx += raycast->ctrl.mouse_dx;
+    raycast->latch_dy += raycast->ctrl.mouse_dy;
 
-            old_plane_x = raycast->plane_x;
-            raycast->plane_x = raycast->plane_x * cos(-rot_speed) - raycast->plane_y * sin(-rot_speed);
-            raycast->plane_y = old_plane_x * sin(-rot_speed) + raycast->plane_y * cos(-rot_speed);
-        }
+    const uint32_t input_time = raycast->ctrl.mouse_time;
+    raycast->ctrl.mouse_dx = raycast->ctrl.mouse_dy = 0;
+    raycast->ctrl.mouse_time = 0;
+
+    return input_time;
+}
+
+/* VISIBILITY functions */
+
+void _alloc_visibility(Raycast_Data* raycast) // one bit per map cell, cells are indexed by y * (width+1) + x
+{
+    const uint32_t cells = (raycast->map->width + 1) * (raycast->map->height + 1);
+
+    free(raycast->vis_cells);
+    raycast->vis_cells = calloc((cells + 31) / 32, sizeof(uint32_t));
+
+    raycast->vis_min_x = raycast->vis_min_y = UINT16_MAX;
+    raycast->vis_max_x = raycast->vis_max_y = 0;
+
+    free(raycast->vis_face_bits);
+    free(raycast->vis_faces);
+    raycast->vis_face_bits = NULL, raycast->vis_faces = NULL;
+    raycast->vis_face_count = 0;
+
+    if (raycast->track_visibility) {
+        raycast->vis_face_bits = calloc((cells * 4 + 31) / 32, sizeof(uint32_t));
+        raycast->vis_faces = malloc(cells * 4 * sizeof(Raycast_Face)); // a column can hit several faces with low walls, each face is listed once
     }
+}
 
-    if (raycast->ctrl.mouse_my)
-    {
-        raycast->ctrl.mouse_my = SDL_FALSE;
+void _mark_face(Raycast_Data* raycast, const int x, const int y, const uint8_t face)
+{
+    const uint32_t bit = (y * (raycast->map->width + 1) + x) * 4 + face;
+    if ((raycast->vis_face_bits[bit >> 5] >> (bit & 31)) & 1) return;
 
-        const float cam_z_speed = .5f * abs(raycast->ctrl.mouse_dy) * clock->delta;
+    raycast->vis_face_bits[bit >> 5] |= 1u << (bit & 31);
+    raycast->vis_faces[raycast->vis_face_count++] = (Raycast_Face){ x, y, face };
+}
 
-        if (raycast->ctrl.mouse_dy < 0) // Look up
-        {
-            raycast->pitch += 400 * cam_z_speed;
-            if(raycast->pitch > 200) raycast->pitch = 200;
-        }
-        else if (raycast->ctrl.mouse_dy > 0) // Look down
-        {
-            raycast->pitch -= 400 * cam_z_speed;
-            if(raycast->pitch < -200) raycast->pitch = -200;
-        }
+void _mark_cell(Raycast_Data* raycast, const int x, const int y)
+{
+    const uint32_t cell = y * (raycast->map->width + 1) + x;
+    raycast->vis_cells[cell >> 5] |= 1u << (cell & 31);
+}
+
+SDL_bool _is_cell_marked(const Raycast_Data* raycast, const int x, const int y)
+{
+    if (x < 0 || y < 0 || x > raycast->map->width || y > raycast->map->height) return SDL_FALSE;
+
+    const uint32_t cell = y * (raycast->map->width + 1) + x;
+    return (raycast->vis_cells[cell >> 5] >> (cell & 31)) & 1;
+}
+
+void _bound_cells(Raycast_Data* raycast, const int x, const int y)
+{
+    if (x < raycast->vis_min_x) raycast->vis_min_x = x;
+    if (x > raycast->vis_max_x) raycast->vis_max_x = x;
+    if (y < raycast->vis_min_y) raycast->vis_min_y = y;
+    if (y > raycast->vis_max_y) raycast->vis_max_y = y;
+}
+
+void _clear_visibility(Raycast_Data* raycast) // only the rows of the last frame bounds are cleared
+{
+    const uint32_t stride = raycast->map->width + 1;
+
+    for (int y = raycast->vis_min_y; y <= raycast->vis_max_y; y++)
+    {
+        const uint32_t first = (y * stride + raycast->vis_min_x) >> 5;
+        const uint32_t last = (y * stride + raycast->vis_max_x) >> 5;
+        memset(raycast->vis_cells + first, 0, (last - first + 1) * sizeof(uint32_t));
     }
 
-    // To reset the view (up/down).
-    // if (raycast->pitch > 0) raycast->pitch = fmaxf(0, raycast->pitch - 100 * rot_speed);
-    // if (raycast->pitch < 0) raycast->pitch = fminf(0, raycast->pitch + 100 * rot_speed);
+    raycast->vis_min_x = raycast->vis_min_y = UINT16_MAX;
+    raycast->vis_max_x = raycast->vis_max_y = 0;
+
+    /* The faces bits are cleared from the list of the last frame */
+
+    for (uint32_t i = 0; raycast->vis_faces && i < raycast->vis_face_count; i++) {
+        const Raycast_Face* face = &raycast->vis_faces[i];
+        const uint32_t bit = (face->y * stride + face->x) * 4 + face->face;
+        raycast->vis_face_bits[bit >> 5] &= ~(1u << (bit & 31));
+    }
 
+    raycast->vis_face_count = 0;
 }
 
 /* RAYCASTING and RENDERING or BUFFERING functions */
 
+const uint8_t* _shade_colormap(const Raycast_Data* raycast, const float dist, const int base, const uint8_t light) // colormap of a surface at this distance and light
+{
+    // the base and the fog darken by levels, the light scales what is left of the brightness
+    const float brightness = (1.f - (base + dist * raycast->fog) / PALETTE_SHADES) * light / 255.f;
+
+    // fminf first so that an infinite (or NaN) distance gives the darkest level
+    const float level = fmaxf(0.f, fminf(PALETTE_SHADES - 1, PALETTE_SHADES * (1.f - brightness)));
+    return raycast->palette->colormap[(int)level];
+}
+
+uint8_t _cell_light(const Raycast_Data* raycast, const int x, const int y) // baked light of a floor/ceiling cell, full bright without lightmap
+{
+    if (!raycast->lightmap || x < 0 || y < 0 || x > raycast->map->width || y > raycast->map->height) return 255;
+    return raycast->lightmap->cells[y * raycast->lightmap->stride + x];
+}
+
+uint8_t _face_light(const Raycast_Data* raycast, const int x, const int y, const uint8_t face)
+{
+    if (!raycast->lightmap) return 255;
+    return raycast->lightmap->faces[(y * raycast->lightmap->stride + x) * 4 + face];
+}
+
+uint32_t _light_pixel(const uint32_t color, const uint8_t light) // R and B are scaled together, then G
+{
+    const uint32_t l = light + 1;
+    return ((color & 0xFF00FF) * l >> 8 & 0xFF00FF) | ((color & 0x00FF00) * l >> 8 & 0x00FF00);
+}
+
+/* KERNELS: the inner loops of the 32 bits mode, specialized by macros for each combination of texture size (64, 128 or
+   any power of two), lighting and spans, so that they don't test the configuration per pixel. _select_kernels picks
+   them when the textures or the lighting change, the vectorized ones of the CPU (see kernels.h) where they exist. */
+
+// with SPANS the kernel stops at the first pixel out of the cell of the span, and returns its column
+#define ROW_KERNEL(NAME, TEXTURED, TEX_W, TEX_H, LIT, SPANS)                                    \
+int NAME(struct _Raycast_Row* row, int x, const int x_end)                                      \
+{                                                                                               \
+    const int tex_w = TEX_W ? TEX_W : row->tex_w, tex_h = TEX_H ? TEX_H : row->tex_h;           \
+    int n = (x - row->x_first) / row->x_step;                                                   \
+                                                                                                \
+    for (; x < x_end; x += row->x_step, n++)                                                    \
+    {                                                                                           \
+        const float floor_x = row->x + (float)n * row->stride_x;                                \
+        const float floor_y = row->y + (float)n * row->stride_y;                                \
+        const int cell_x = (int)(floor_x);                                                      \
+        const int cell_y = (int)(floor_y);                                                      \
+                                                                                                \
+        if (SPANS && (cell_x != row->cell_x || cell_y != row->cell_y)) {                        \
+            row->cell_x = cell_x, row->cell_y = cell_y;                                         \
+            break;                                                                              \
+        }                                                                                       \
+                                                                                                \
+        uint32_t color = row->color;                                                            \
+                                                                                                \
+        if (TEXTURED) {                                                                         \
+            const int tx = (int)(tex_w * (floor_x - cell_x)) & (tex_w - 1);                     \
+            const int ty = (int)(tex_h * (floor_y - cell_y)) & (tex_h - 1);                     \
+            color = row->tex[ty * tex_w + tx] >> 1 & 8355711;                                   \
+            if (LIT) color = _light_pixel(color, row->light);                                   \
+        }                                                                                       \
+                                                                                                \
+        row->out[x] = color;                                                                    \
+    }                                                                                           \
+                                                                                                \
+    return x;                                                                                   \
+}
+
+#define COLUMN_KERNEL(NAME, TEX_W, TEX_H, SIDE, LIT)                                            \
+void NAME(const struct _Raycast_Column* column)                                                 \
+{                                                                                               \
+    const int tex_w = TEX_W ? TEX_W : column->tex_w, tex_h = TEX_H ? TEX_H : column->tex_h;     \
+    uint32_t* out = column->out;                                                                \
+                                                                                                \
+    for (int i = 0; i < column->count; i++)                                                     \
+    {                                                                                           \
+        const int tex_y = (int)(column->tex_pos + (float)i * column->tex_step) & (tex_h - 1);   \
+        uint32_t color = column->tex[tex_y * tex_w];                                            \
+        if (SIDE) color = (color >> 1) & 8355711;                                               \
+        if (LIT) color = _light_pixel(color, column->light);                                    \
+        *out = color;                                                                           \
+        out += column->stride;                                                                  \
+    }                                                                                           \
+}
+
+ROW_KERNEL(_row_flat,           0, 1, 1, 0, 0)
+ROW_KERNEL(_row_flat_spans,     0, 1, 1, 0, 1)
+
+#define ROW_KERNELS(SIZE, TEX_W, TEX_H)                                                         \
+ROW_KERNEL(_row_##SIZE,             1, TEX_W, TEX_H, 0, 0)                                      \
+ROW_KERNEL(_row_##SIZE##_spans,     1, TEX_W, TEX_H, 0, 1)                                      \
+ROW_KERNEL(_row_##SIZE##_lit,       1, TEX_W, TEX_H, 1, 1)                                      \
+COLUMN_KERNEL(_column_##SIZE,       TEX_W, TEX_H, 0, 0)                                         \
+COLUMN_KERNEL(_column_##SIZE##_side,    TEX_W, TEX_H, 1, 0)                                     \
+COLUMN_KERNEL(_column_##SIZE##_lit,     TEX_W, TEX_H, 0, 1)                                     \
+COLUMN_KERNEL(_column_##SIZE##_side_lit, TEX_W, TEX_H, 1, 1)
+
+ROW_KERNELS(64, 64, 64)
+ROW_KERNELS(128, 128, 128)
+ROW_KERNELS(any, 0, 0)
+
+void _select_row_kernels(const Raycast_Data* raycast, _Raycast_RowKernel kernels[2], const int w, const int h) // [without spans, with spans]
+{
+    const SDL_bool lit = raycast->lightmap != NULL; // the light only changes between spans
+
+    if (w == 64 && h == 64) kernels[0] = _row_64, kernels[1] = lit ? _row_64_lit : _row_64_spans;
+    else if (w == 128 && h == 128) kernels[0] = _row_128, kernels[1] = lit ? _row_128_lit : _row_128_spans;
+    else kernels[0] = _row_any, kernels[1] = lit ? _row_any_lit : _row_any_spans;
+
+    if (raycast->kernels.cpu->row) kernels[0] = raycast->kernels.cpu->row;
+}
+
+void _select_kernels(Raycast_Data* raycast) // to call when the textures or the lightmap change
+{
+    struct _Raycast_Kernels* kernels = &raycast->kernels;
+
+    kernels->flat[0] = _row_flat, kernels->flat[1] = _row_flat_spans;
+
+    if (raycast->floor_tex) _select_row_kernels(raycast, kernels->floor, raycast->floor_tex->w, raycast->floor_tex->h);
+    if (raycast->ceiling_tex) _select_row_kernels(raycast, kernels->ceiling, raycast->ceiling_tex->w, raycast->ceiling_tex->h);
+    if (raycast->materials) _select_row_kernels(raycast, kernels->material, raycast->materials->w, raycast->materials->h);
+
+    if (!raycast->wall_tex) return;
+
+    const SDL_bool lit = raycast->lightmap != NULL;
+    const int w = raycast->wall_tex->w, h = raycast->wall_tex->h;
+
+    if (w == 64 && h == 64) {
+        kernels->wall[0] = lit ? _column_64_lit : _column_64;
+        kernels->wall[1] = lit ? _column_64_side_lit : _column_64_side;
+    }
+    else if (w == 128 && h == 128) {
+        kernels->wall[0] = lit ? _column_128_lit : _column_128;
+        kernels->wall[1] = lit ? _column_128_side_lit : _column_128_side;
+    }
+    else {
+        kernels->wall[0] = lit ? _column_any_lit : _column_any;
+        kernels->wall[1] = lit ? _column_any_side_lit : _column_any_side;
+    }
+
+    if (!lit && kernels->cpu->column[0]) {
+        kernels->wall[0] = kernels->cpu->column[0];
+        kernels->wall[1] = kernels->cpu->column[1];
+    }
+}
+
+struct _Raycast_Surface {       // texture of a span of floor or ceiling, no pixels (or indices) for the default color
+    const Pixel* pixels;
+    const uint8_t* indices;
+    int w, h;
+    const _Raycast_RowKernel* kernels;
+};
+
+struct _Raycast_Surface _floor_surface(const Raycast_Data* raycast, const Texture* tex, const _Raycast_RowKernel* tex_kernels, uint8_t** layer, const int x, const int y) // texture of a floor or ceiling cell, tex if it has no material
+{
+    const Map* map = raycast->map;
+    const uint8_t material = layer && x >= 0 && y >= 0 && x <= map->width && y <= map->height ? layer[x][y] : 0;
+
+    if (material && material <= raycast->materials->length) {
+        const TexGroup* materials = raycast->materials;
+        return (struct _Raycast_Surface){
+            materials->pixels ? materials->pixels[material-1] : NULL,
+            materials->indices ? materials->indices[material-1] : NULL,
+            materials->w, materials->h, raycast->kernels.material
+        };
+    }
+
+    if (tex) return (struct _Raycast_Surface){ tex->pixels, tex->indices, tex->w, tex->h, tex_kernels };
+    return (struct _Raycast_Surface){ NULL, NULL, 0, 0, raycast->kernels.flat };
+}
+
 void _casting_textured_floor_ceiling(Raycast_Data* raycast) // floor and ceiling casting only for textured mode
 {
-    if (raycast->floor_tex || raycast->ceiling_tex) // TEXTURED MODE
+    // pitch and pos_z are expressed in window pixels, they are brought back to the internal render resolution
+    const float pitch = raycast->pitch * raycast->render_scale;
+    const float pos_z = raycast->pos_z * raycast->render_scale;
+
+    // in interlaced modes only one pixel out of two is cast, the others are reconstructed from the previous frame
+    const SDL_bool partial = raycast->interlace && raycast->history_valid;
+    const int x_step = partial ? 2 : 1;
+
+    if (raycast->floor_tex || raycast->ceiling_tex || raycast->materials) // TEXTURED MODE
     {
-        for(int y = 0; y < raycast->win_h; ++y)
+        for(int y = 0; y < raycast->render_h; ++y)
         {
             // whether this section is floor or ceiling
-            const SDL_bool is_floor = y > raycast->h_win_h + raycast->pitch;
+            const SDL_bool is_floor = y > raycast->h_render_h + pitch;
 
             // rayDir for leftmost ray (x = 0) and rightmost ray (x = w)
             const float ray_dir_x0 = raycast->dir_x - raycast->plane_x;
@@ -242,14 +550,14 @@ void _casting_textured_floor_ceiling(Raycast_Data* raycast) // floor and ceiling
             const float ray_dir_y1 = raycast->dir_y + raycast->plane_y;
 
             // Current y position compared to the center of the screen (the horizon)
-            const int p = is_floor ? (y - raycast->h_win_h - raycast->pitch) : (raycast->h_win_h - y + raycast->pitch);
+            const int p = is_floor ? (y - raycast->h_render_h - pitch) : (raycast->h_render_h - y + pitch);
 
             // Vertical position of the camera.
             // NOTE: with 0.5, it's exactly in the center between floor and ceiling,
             // matching also how the walls are being raycasted. For different values
             // than 0.5, a separate loop must be done for ceiling and floor since
             // they're no longer symmetrical.
-            const float cam_z = is_floor ? (0.5 * raycast->win_h + raycast->pos_z) : (0.5 * raycast->win_h - raycast->pos_z);
+            const float cam_z = is_floor ? (0.5 * raycast->render_h + pos_z) : (0.5 * raycast->render_h - pos_z);
 
             // Horizontal distance from the camera to the floor for the current row.
             // 0.5 is the z position exactly in the middle between floor and ceiling.
@@ -269,58 +577,107 @@ void _casting_textured_floor_ceiling(Raycast_Data* raycast) // floor and ceiling
 
             // calculate the real world step vector we have to add for each x (parallel to camera plane)
             // adding step by step avoids multiplications with a weight in the inner loop
-            const float floor_ceiling_step_x = row_dist * (ray_dir_x1 - ray_dir_x0) / raycast->win_w;
-            const float floor_ceiling_step_y = row_dist * (ray_dir_y1 - ray_dir_y0) / raycast->win_w;
+            const float floor_ceiling_step_x = row_dist * (ray_dir_x1 - ray_dir_x0) / raycast->render_w;
+            const float floor_ceiling_step_y = row_dist * (ray_dir_y1 - ray_dir_y0) / raycast->render_w;
+
+            // first column cast on this row, alternating every frame (and every row for the checkerboard)
+            const int x_first = !partial ? 0 : raycast->interlace == INTERLACE_COLUMNS ? raycast->field : (y + raycast->field) & 1;
 
-            // real world coordinates of the leftmost column. This will be updated as we step to the right.
-            float floor_ceiling_x = raycast->pos_x + row_dist * ray_dir_x0;
-            float floor_ceiling_y = raycast->pos_y + row_dist * ray_dir_y0;
+            // real world coordinates of the first column. This will be updated as we step to the right.
+            float floor_ceiling_x = raycast->pos_x + row_dist * ray_dir_x0 + floor_ceiling_step_x * x_first;
+            float floor_ceiling_y = raycast->pos_y + row_dist * ray_dir_y0 + floor_ceiling_step_y * x_first;
 
-            for(int x = 0; x < raycast->win_w; ++x)
+            const float floor_ceiling_stride_x = floor_ceiling_step_x * x_step;
+            const float floor_ceiling_stride_y = floor_ceiling_step_y * x_step;
+
+            // the baked light and the material are looked up once per span of pixels on the same cell
+            uint8_t** layer = !raycast->materials ? NULL : is_floor ? raycast->map->floors : raycast->map->ceilings;
+            const SDL_bool spans = raycast->lightmap || layer;
+            const Texture* tex = is_floor ? raycast->floor_tex : raycast->ceiling_tex;
+            const _Raycast_RowKernel* tex_kernels = is_floor ? raycast->kernels.floor : raycast->kernels.ceiling;
+
+            int span_x = (int)(floor_ceiling_x), span_y = (int)(floor_ceiling_y);
+            uint8_t light = _cell_light(raycast, span_x, span_y);
+            struct _Raycast_Surface surface = _floor_surface(raycast, tex, tex_kernels, layer, span_x, span_y);
+
+            if (raycast->palette) // PALETTIZED MODE, the whole row is at the same distance so it shares one colormap per light level
             {
-                // the cell coord is simply got from the integer parts of floor_x and floor_y
-                const int cell_x = (int)(floor_ceiling_x);
-                const int cell_y = (int)(floor_ceiling_y);
+                const uint8_t flat = Palette_Nearest(raycast->palette, is_floor ? 0x007B00 : 0x003FFF);
+                int base = surface.indices ? PALETTE_SHADES / 2 : 0; // textures a bit darker, like the 32 bits mode
 
-                uint32_t color;
+                uint8_t* row = raycast->index_buffer + y * raycast->render_w;
+                const uint8_t* shade = _shade_colormap(raycast, row_dist, base, light);
 
-                if(is_floor) // floor
+                for(int x = x_first; x < raycast->render_w; x += x_step)
                 {
-                    if (raycast->floor_tex) // get the texture coordinate from the fractional part
-                    {
-                        const int tx = (int)(raycast->floor_tex->w * (floor_ceiling_x - cell_x)) & (raycast->floor_tex->w - 1);
-                        const int ty = (int)(raycast->floor_tex->h * (floor_ceiling_y - cell_y)) & (raycast->floor_tex->h - 1);
-                        color = raycast->floor_tex->pixels[ty * raycast->floor_tex->w + tx] >> 1 & 8355711; // get pixel and make a bit darker
+                    const int cell_x = (int)(floor_ceiling_x);
+                    const int cell_y = (int)(floor_ceiling_y);
+
+                    if (spans && (cell_x != span_x || cell_y != span_y)) {
+                        span_x = cell_x, span_y = cell_y;
+                        const uint8_t span_light = _cell_light(raycast, cell_x, cell_y);
+                        if (layer) surface = _floor_surface(raycast, tex, tex_kernels, layer, cell_x, cell_y);
+                        const int span_base = surface.indices ? PALETTE_SHADES / 2 : 0;
+                        if (span_light != light || span_base != base) light = span_light, base = span_base, shade = _shade_colormap(raycast, row_dist, base, light);
                     }
-                    else color = 0x007B00; // if there is no texture, we apply a default color
-                }
-                else // ceiling
-                {
-                    if (raycast->ceiling_tex) // get the texture coordinate from the fractional part
-                    {
-                        const int tx = (int)(raycast->ceiling_tex->w * (floor_ceiling_x - cell_x)) & (raycast->ceiling_tex->w - 1);
-                        const int ty = (int)(raycast->ceiling_tex->h * (floor_ceiling_y - cell_y)) & (raycast->ceiling_tex->h - 1);
-                        color = raycast->ceiling_tex->pixels[ty * raycast->ceiling_tex->w + tx] >> 1 & 8355711; // get pixel and make a bit darker
+
+                    if (surface.indices) {
+                        const int tx = (int)(surface.w * (floor_ceiling_x - cell_x)) & (surface.w - 1);
+                        const int ty = (int)(surface.h * (floor_ceiling_y - cell_y)) & (surface.h - 1);
+                        row[x] = shade[surface.indices[ty * surface.w + tx]];
                     }
-                    else color = 0x003FFF; // if there is no texture, we apply a default color
+                    else row[x] = shade[flat];
+
+                    floor_ceiling_x += floor_ceiling_stride_x;
+                    floor_ceiling_y += floor_ceiling_stride_y;
+                }
+
+                continue;
+            }
+
+            // if there is no texture, we apply a default color
+            const uint32_t flat = is_floor ? 0x007B00 : 0x003FFF;
+
+            struct _Raycast_Row row = {
+                raycast->buffer + y * raycast->stride,
+                floor_ceiling_x, floor_ceiling_y,
+                floor_ceiling_stride_x, floor_ceiling_stride_y,
+                x_first, x_step, span_x, span_y,
+                NULL, 0, 0, flat, 255
+            };
+
+            for (int x = x_first; x < raycast->render_w; )
+            {
+                // a new span (the kernel stopped on its cell): the light and the texture are looked up once for all its pixels
+                if (x != x_first) {
+                    light = _cell_light(raycast, row.cell_x, row.cell_y);
+                    if (layer) surface = _floor_surface(raycast, tex, tex_kernels, layer, row.cell_x, row.cell_y);
                 }
 
-                // write in buffer
-                raycast->buffer[y * raycast->win_w + x] = color;
+                row.tex = surface.pixels, row.tex_w = surface.w, row.tex_h = surface.h;
+                row.color = raycast->lightmap ? _light_pixel(flat, light) : flat;
+                row.light = light;
 
-                // step increment
-                floor_ceiling_x += floor_ceiling_step_x;
-                floor_ceiling_y += floor_ceiling_step_y;
+                // without spans the kernel casts the whole row at once
+                x = surface.kernels[spans](&row, x, raycast->render_w);
             }
         }
     }
+    else if (raycast->palette) // PALETTIZED WITHOUT FLOOR AND CEILING
+    {
+        const uint8_t floor_color = Palette_Nearest(raycast->palette, 0x007B00);
+        const uint8_t ceiling_color = Palette_Nearest(raycast->palette, 0x003FFF);
+
+        for(int y = 0; y < raycast->render_h; y++)
+            memset(raycast->index_buffer + y * raycast->render_w, y > raycast->h_render_h + pitch ? floor_color : ceiling_color, raycast->render_w);
+    }
     else // TEXTURED WITHOUT FLOOR AND CEILING
     {
-        for(int x = 0; x < raycast->win_w; x++) {
-            for(int y = raycast->h_win_h - 1 + raycast->pitch; y < raycast->win_h ; y++) // floor
-                raycast->buffer[y * raycast->win_w + x] = 0x007B00;
-            for(int y = raycast->h_win_h - 1 - raycast->pitch; y < raycast->win_h ; y++) // ceiling
-                raycast->buffer[(raycast->win_h - y - 1)* raycast->win_w + x] = 0x003FFF;
+        for(int x = 0; x < raycast->render_w; x++) {
+            for(int y = fmaxf(0, raycast->h_render_h - 1 + pitch); y < raycast->render_h ; y++) // floor
+                raycast->buffer[y * raycast->stride + x] = 0x007B00;
+            for(int y = fmaxf(0, raycast->h_render_h - 1 - pitch); y < raycast->render_h ; y++) // ceiling
+                raycast->buffer[(raycast->render_h - y - 1)* raycast->stride + x] = 0x003FFF;
         }
     }
 }
@@ -351,13 +708,242 @@ void _render_colored_floor_ceiling(SDL_Renderer* renderer, Raycast_Data* raycast
     );
 }
 
+struct _Raycast_Hit {           // wall face hit by the ray of a column
+    unsigned x;
+    float ray_dir_x, ray_dir_y;
+    int map_x, map_y;
+    int side, step_x, step_y;
+    float dist;                 // perpendicular distance of the face
+    float exit_dist;            // perpendicular distance where the ray leaves the cell, for the top of a low wall
+    float height;               // 1 for a full wall
+};
+
+void _fill_colored(SDL_Renderer* renderer, Raycast_Data* raycast, const unsigned x, const int y0, const int y1, const RGB color, const float dist)
+{
+    if (y0 > y1) return;
+
+    if (renderer) {
+        SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
+        SDL_RenderDrawLine(renderer, x, y0, x, y1);
+    }
+    else if (raycast->palette) {
+        const uint8_t index = _shade_colormap(raycast, dist, 0, 255)[Palette_Nearest(raycast->palette, color[0] << 16 | color[1] << 8 | color[2])];
+        for(int y = y0; y < y1+1; y++)
+            raycast->index_buffer[y * raycast->render_w + x] = index;
+    }
+    else for(int y = y0; y < y1+1; y++) // buffered colored mode, used by batch rendering
+        raycast->buffer[y * raycast->stride + x] = color[0] << 16 | color[1] << 8 | color[2];
+}
+
+void _push_low_wall(Raycast_Data* raycast, const int x, const float dist, const int16_t top) // walls come front to back and each top is at most the previous one
+{
+    const int n = raycast->low_count[x];
+    const int i = x * LOW_WALL_LAYERS + (n < LOW_WALL_LAYERS ? n : LOW_WALL_LAYERS - 1);
+
+    // past the last layer only its top moves up, the sprites between the walls merged there are hidden a bit early rather than drawn over a wall
+    if (n < LOW_WALL_LAYERS) raycast->low_depth[i] = dist, raycast->low_count[x] = n + 1;
+    raycast->low_top[i] = top;
+}
+
+void _copy_low_walls(Raycast_Data* raycast, const int x, const int from)
+{
+    memcpy(raycast->low_depth + x * LOW_WALL_LAYERS, raycast->low_depth + from * LOW_WALL_LAYERS, LOW_WALL_LAYERS * sizeof(float));
+    memcpy(raycast->low_top + x * LOW_WALL_LAYERS, raycast->low_top + from * LOW_WALL_LAYERS, LOW_WALL_LAYERS * sizeof(int16_t));
+    raycast->low_count[x] = raycast->low_count[from];
+}
+
+int _low_wall_clip(const Raycast_Data* raycast, const int x, const float depth) // first row hidden by the low walls in front of depth, render_h if none
+{
+    const float* low_depth = raycast->low_depth + x * LOW_WALL_LAYERS;
+    const int16_t* low_top = raycast->low_top + x * LOW_WALL_LAYERS;
+    int end = raycast->render_h;
+
+    for (int i = 0; i < raycast->low_count[x] && low_depth[i] < depth; i++) {
+        end = low_top[i];
+    }
+
+    return end;
+}
+
+int _draw_wall(SDL_Renderer* renderer, Raycast_Data* raycast, const struct _Raycast_Hit* hit, const int clip_end) // draws the rows of the wall down to clip_end, returns the last row left uncovered above it
+{
+    const float pitch = raycast->pitch * raycast->render_scale;
+    const float pos_z = raycast->pos_z * raycast->render_scale;
+
+    const SDL_bool partial = raycast->interlace && raycast->history_valid;
+    const int y_step = partial && raycast->interlace == INTERLACE_CHECKERBOARD ? 2 : 1;
+    const unsigned x = hit->x;
+
+    /* face of the wall hit, its baked light is shared by the whole column */
+
+    const uint8_t face = hit->side == 0 ? (hit->step_x > 0 ? FACE_WEST : FACE_EAST) : (hit->step_y > 0 ? FACE_NORTH : FACE_SOUTH);
+    const uint8_t light = _face_light(raycast, hit->map_x, hit->map_y, face);
+
+    if (raycast->vis_faces) _mark_face(raycast, hit->map_x, hit->map_y, face);
+
+    const float perp_wall_dist = hit->dist;
+
+    /* Calculate height of line to draw on screen, a low wall only fills the bottom of it */
+
+    const int line_height = (int)(raycast->render_h / perp_wall_dist);
+
+    /* calculate lowest and highest pixel to fill in current stripe */
+
+    int draw_start = -line_height / 2.f + line_height * (1.f - hit->height) + raycast->h_render_h + pitch + (pos_z / perp_wall_dist);
+
+    int draw_end = line_height / 2.f + raycast->h_render_h + pitch + (pos_z / perp_wall_dist);
+    if (draw_end > clip_end) draw_end = clip_end;
+
+    /* The top of a low wall is seen between its near and far edges when the eye is above it */
+
+    int top_start = draw_start;
+
+    if (hit->height < 1.f) {
+        const int exit_height = (int)(raycast->render_h / hit->exit_dist);
+        top_start = -exit_height / 2.f + exit_height * (1.f - hit->height) + raycast->h_render_h + pitch + (pos_z / hit->exit_dist);
+    }
+
+    const int uncovered = (top_start < draw_start ? top_start : draw_start) - 1;
+    const int top_end = draw_start - 1 < clip_end ? draw_start - 1 : clip_end;
+
+    if (top_start < 0) top_start = 0;
+    if (draw_start < 0) draw_start = 0;
+
+    const uint8_t cell = raycast->map->data[hit->map_x][hit->map_y];
+
+    if (raycast->wall_tex) // TEXTURED MODE
+    {
+        /* texturing calculations */
+
+        const uint8_t tex_num = cell - 1; // 1 subtracted from it so that texture 0 can be used !
+        const uint16_t tex_w = raycast->wall_tex->w, tex_h = raycast->wall_tex->h;
+
+        /* calculate value of wall_x */
+
+        float wall_x; // where exactly the wall was hit
+        if (hit->side == 0) wall_x = raycast->pos_y + perp_wall_dist * hit->ray_dir_y;
+        else                wall_x = raycast->pos_x + perp_wall_dist * hit->ray_dir_x;
+        wall_x -= floor(wall_x);
+
+        /* x coordinate on the texture */
+
+        int tex_x = (int)(wall_x * (float)(tex_w));
+        if(hit->side == 0 && hit->ray_dir_x > 0) tex_x = tex_w - tex_x - 1;
+        if(hit->side == 1 && hit->ray_dir_y < 0) tex_x = tex_w - tex_x - 1;
+
+        /* How much to increase the texture coordinate per screen pixel */
+
+        const float step = (float)tex_h / line_height;
+
+        /* First pixel filled in this column (shifted by one every other column and frame in checkerboard mode) */
+
+        const int y_first = y_step == 1 ? draw_start : draw_start + ((draw_start + (int)x + raycast->field) & 1);
+        const float y_tex_step = step * y_step;
+
+        /* Starting texture coordinate */ // tex_y first initialize in float (tex_pos) for precision during the addition of step.
+
+        float tex_pos = (y_first - pitch - (pos_z / perp_wall_dist) - raycast->h_render_h + line_height / 2.f) * step;
+
+        if (raycast->palette) // PALETTIZED MODE, the column and its side share one colormap
+        {
+            const uint8_t* shade = _shade_colormap(raycast, perp_wall_dist, hit->side == 1 ? PALETTE_SHADES / 2 : 0, light);
+            const uint8_t* texels = raycast->wall_tex->indices[tex_num] + tex_x;
+
+            for(int y = y_first; y < draw_end+1; y += y_step) {
+                const int tex_y = (int)tex_pos & (tex_h - 1); tex_pos += y_tex_step;
+                raycast->index_buffer[y * raycast->render_w + x] = shade[texels[tex_y * tex_w]];
+            }
+        }
+        else if (y_first <= draw_end) // BUG: If we are stuck to a wall at spawn, the side where you are stuck is not displayed.
+        {
+            /* The kernel of the side masks the texture row with (tex_h - 1) in case of overflow, and makes the y-sides
+               darker: R, G and B byte each divided through two with a "shift" and an "and" */
+
+            const struct _Raycast_Column column = {
+                raycast->buffer + y_first * raycast->stride + x,
+                raycast->stride * y_step,
+                (draw_end - y_first) / y_step + 1,
+                raycast->wall_tex->pixels[tex_num] + tex_x,
+                tex_w, tex_h,
+                tex_pos, y_tex_step,
+                light
+            };
+
+            raycast->kernels.wall[hit->side](&column);
+        }
+
+        /* Top of a low wall: each row is at the distance where the plane of the top crosses it, like the floor */
+
+        const float eye = raycast->render_h * (.5f - hit->height) + pos_z; // height of the eye above the top
+        const float horizon = raycast->h_render_h + pitch;
+        const int top_first = y_step == 1 ? top_start : top_start + ((top_start + (int)x + raycast->field) & 1);
+
+        for (int y = top_first; y <= top_end; y += y_step)
+        {
+            // kept in the cell, the division is off by a row at its edges
+            const float dist = fminf(fmaxf(eye / (y - horizon), perp_wall_dist), hit->exit_dist);
+
+            const float floor_x = raycast->pos_x + dist * hit->ray_dir_x;
+            const float floor_y = raycast->pos_y + dist * hit->ray_dir_y;
+            const int tx = (int)(tex_w * (floor_x - floorf(floor_x))) & (tex_w - 1);
+            const int ty = (int)(tex_h * (floor_y - floorf(floor_y))) & (tex_h - 1);
+
+            if (raycast->palette)
+                raycast->index_buffer[y * raycast->render_w + x] = _shade_colormap(raycast, dist, 0, light)[raycast->wall_tex->indices[tex_num][ty * tex_w + tx]];
+            else {
+                const uint32_t color = raycast->wall_tex->pixels[tex_num][ty * tex_w + tx];
+                raycast->buffer[y * raycast->stride + x] = light != 255 ? _light_pixel(color, light) : color;
+            }
+        }
+    }
+    else // COLORED MODE
+    {
+        /* Apply color according to the side of the wall and draw line */
+
+        RGB color, top_color;
+
+        for (unsigned i = 0; i < raycast->map->wall_num; i++)
+            if (cell == i+1) {
+                memcpy(color, raycast->map->wall_color[i], sizeof(RGB));
+                break;
+            }
+
+        for (unsigned i = 0; i < 3; i++)
+            top_color[i] = color[i] * (light + 1) >> 8;
+
+        if (hit->side == 1) for (unsigned i = 0; i < 3; i++)
+            if (color[i] > 0) color[i] /= 2;
+
+        for (unsigned i = 0; i < 3; i++)
+            color[i] = color[i] * (light + 1) >> 8;
+
+        _fill_colored(renderer, raycast, x, draw_start, draw_end, color, perp_wall_dist);
+        _fill_colored(renderer, raycast, x, top_start, top_end, top_color, hit->exit_dist);
+    }
+
+    return uncovered < clip_end ? uncovered : clip_end;
+}
+
 void _casting_walls(SDL_Renderer* renderer, Raycast_Data* raycast) // this function (in addition to casting) buffers for textured mode or directly renders for colored mode
 {
-    for (unsigned x = 0; x < raycast->win_w; x++)
+    const float pitch = raycast->pitch * raycast->render_scale;
+    const float pos_z = raycast->pos_z * raycast->render_scale;
+
+    // columns mode casts one column out of two, checkerboard casts every column but fills one pixel out of two
+    const SDL_bool partial = raycast->interlace && raycast->history_valid;
+    const unsigned x_first = partial && raycast->interlace == INTERLACE_COLUMNS ? raycast->field : 0;
+    const unsigned x_step = partial && raycast->interlace == INTERLACE_COLUMNS ? 2 : 1;
+
+    // the rays only go on past the walls lower than the ceiling, a flat map stops at the first hit as always
+    uint8_t** heights = raycast->map->heights;
+
+    if (raycast->vis_cells) _clear_visibility(raycast);
+
+    for (unsigned x = x_first; x < raycast->render_w; x += x_step)
     {
         /* calculate ray position and direction */
 
-        const float camera_x = 2 * x / (float)(raycast->win_w) - 1; //x-coordinate in camera space
+        const float camera_x = 2 * x / (float)(raycast->render_w) - 1; //x-coordinate in camera space
         const float ray_dir_x = raycast->dir_x + raycast->plane_x * camera_x;
         const float ray_dir_y = raycast->dir_y + raycast->plane_y * camera_x;
 
@@ -374,13 +960,12 @@ void _casting_walls(SDL_Renderer* renderer, Raycast_Data* raycast) // this funct
 
         const float delta_dist_x = (ray_dir_x == 0) ? 1e30 : fabsf(1 / ray_dir_x);
         const float delta_dist_y = (ray_dir_y == 0) ? 1e30 : fabsf(1 / ray_dir_y);
-        float perp_wall_dist;
 
         /* what direction to step in x or y-direction (either +1 or -1) */
     
         int step_x, step_y;
 
-        /* hit: was there a wall hit? & side: was a NS or a EW wall hit? */
+        /* hit: was there a full wall hit (1) or is the column covered by low walls (2)? & side: was a NS or a EW wall hit? */
 
         int hit = 0, side;
 
@@ -407,8 +992,20 @@ void _casting_walls(SDL_Renderer* renderer, Raycast_Data* raycast) // this funct
             side_dist_y = (on_map_pos_y + 1.f - raycast->pos_y) * delta_dist_y;
         }
 
+        /* Low walls are drawn front to back as they are hit, each one covers the rows below its top for the farther
+           ones. The ray stops at a full wall, or once the rows left are above the ceiling line where it is. */
+
+        struct _Raycast_Hit wall = { x, ray_dir_x, ray_dir_y, 0, 0, 0, step_x, step_y, 0.f, 0.f, 1.f };
+        int clip_end = raycast->render_h - 1;
+
+        if (raycast->low_count) raycast->low_count[x] = 0;
+
         /* perform DDA to find the index of squares colliding with the ray  */
 
+        /* cells crossed by the ray are recorded for the visibility of the sprites */
+
+        if (raycast->vis_cells) _mark_cell(raycast, on_map_pos_x, on_map_pos_y);
+
         while (hit == 0)
         {
             /* jump to next map square, either in x-direction, or in y-direction */
@@ -426,142 +1023,1130 @@ void _casting_walls(SDL_Renderer* renderer, Raycast_Data* raycast) // this funct
                 side = 1;
             }
 
-            /* Check if ray has hit a wall */
-
-            if (raycast->map->data[on_map_pos_x][on_map_pos_y] > 0) hit = 1;
-        }
-
-        /* Calculate distance projected on camera direction (Euclidean distance would give fisheye effect!) */
+            if (raycast->vis_cells) _mark_cell(raycast, on_map_pos_x, on_map_pos_y);
 
-        if (side == 0) perp_wall_dist = side_dist_x - delta_dist_x;
-        else           perp_wall_dist = side_dist_y - delta_dist_y;
-
-        /* Calculate height of line to draw on screen */
+            /* Check if ray has hit a wall */
 
-        const int line_height = (int)(raycast->win_h / perp_wall_dist);
+            if (raycast->map->data[on_map_pos_x][on_map_pos_y] == 0) continue;
 
-        /* calculate lowest and highest pixel to fill in current stripe */
+            wall.map_x = on_map_pos_x, wall.map_y = on_map_pos_y, wall.side = side;
 
-        int draw_start = -line_height / 2.f + raycast->h_win_h + raycast->pitch + (raycast->pos_z / perp_wall_dist);
-        if (draw_start < 0) draw_start = 0;
+            /* Calculate distance projected on camera direction (Euclidean distance would give fisheye effect!) */
 
-        int draw_end = line_height / 2.f + raycast->h_win_h + raycast->pitch + (raycast->pos_z / perp_wall_dist);
-        if (draw_end >= raycast->win_h) draw_end = raycast->win_h - 1;
+            if (side == 0) wall.dist = side_dist_x - delta_dist_x;
+            else           wall.dist = side_dist_y - delta_dist_y;
 
-        if (raycast->wall_tex) // TEXTURED MODE
-        {
-            /* texturing calculations */
+            if (!heights || heights[on_map_pos_x][on_map_pos_y] == MAP_WALL_HEIGHT) { hit = 1; break; }
 
-            const uint8_t tex_num = raycast->map->data[on_map_pos_x][on_map_pos_y] - 1; // 1 subtracted from it so that texture 0 can be used !
+            wall.exit_dist = side_dist_x < side_dist_y ? side_dist_x : side_dist_y;
+            wall.height = heights[on_map_pos_x][on_map_pos_y] / (float)MAP_WALL_HEIGHT;
 
-            /* calculate value of wall_x */
+            clip_end = _draw_wall(renderer, raycast, &wall, clip_end);
+            wall.height = 1.f;
 
-            float wall_x; // where exactly the wall was hit
-            if (side == 0) wall_x = raycast->pos_y + perp_wall_dist * ray_dir_y;
-            else           wall_x = raycast->pos_x + perp_wall_dist * ray_dir_x;
-            wall_x -= floor(wall_x);
+            // the sprites behind this low wall are hidden below the top of everything drawn so far
+            if (raycast->low_count) _push_low_wall(raycast, x, wall.dist, clip_end + 1);
 
-            /* x coordinate on the texture */
+            // the walls farther than the cell are at most full height, so below the ceiling line at its far edge
+            const int ceiling_height = (int)(raycast->render_h / wall.exit_dist);
+            const int ceiling_row = -ceiling_height / 2.f + raycast->h_render_h + pitch + (pos_z / wall.exit_dist);
+            if (clip_end < 0 || (pos_z < raycast->h_render_h && clip_end < ceiling_row)) hit = 2;
+        }
 
-            int tex_x = (int)(wall_x * (float)(raycast->wall_tex->w));
-            if(side == 0 && ray_dir_x > 0) tex_x = raycast->wall_tex->w - tex_x - 1;
-            if(side == 1 && ray_dir_y < 0) tex_x = raycast->wall_tex->w - tex_x - 1;
+        /* a DDA is monotonous, so the crossed cells are within the bounds of the first and the last one */
 
-            /* How much to increase the texture coordinate per screen pixel */
+        if (raycast->vis_cells) {
+            _bound_cells(raycast, (int)(raycast->pos_x), (int)(raycast->pos_y));
+            _bound_cells(raycast, on_map_pos_x, on_map_pos_y);
+        }
 
-            const float step = (float)raycast->wall_tex->h / line_height;
+        /* Depth of the column for the sprites */
 
-            /* Starting texture coordinate */ // tex_y first initialize in float (tex_pos) for precision during the addition of step.
+        if (raycast->z_buffer) raycast->z_buffer[x] = wall.dist;
 
-            float tex_pos = (draw_start - raycast->pitch - (raycast->pos_z / perp_wall_dist) - raycast->h_win_h + line_height / 2.f) * step;
+        if (hit == 1) _draw_wall(renderer, raycast, &wall, clip_end);
+    }
+}
 
-            for(int y = draw_start; y < draw_end+1; y++) // BUG: If we are stuck to a wall at spawn, the side where you are stuck is not displayed.
-            {
-                /* Cast the texture coordinate to integer, and mask with (tex_h - 1) in case of overflow */
+SDL_bool _is_sprite_visible(const Raycast_Data* raycast, const Sprite* sprite) // a sprite is one cell wide, it can overlap 4 cells
+{
+    const int x0 = floorf(sprite->x - .5f), y0 = floorf(sprite->y - .5f);
 
-                const int tex_y = (int)tex_pos; tex_pos += step;
-                uint32_t color = raycast->wall_tex->pixels[tex_num][tex_y * raycast->wall_tex->w + tex_x];
+    return _is_cell_marked(raycast, x0, y0) || _is_cell_marked(raycast, x0 + 1, y0)
+        || _is_cell_marked(raycast, x0, y0 + 1) || _is_cell_marked(raycast, x0 + 1, y0 + 1);
+}
 
-                /* make color darker for y-sides: R, G and B byte each divided through two with a "shift" and an "and" */
+SDL_bool _is_bucket_in_frustum(const Raycast_Data* raycast, const float inv_det, const int bx, const int by)
+{
+    /* The bucket bounds are enlarged by the half width of a sprite, then culled if all their corners are
+       outside of the same side of the view: behind the camera, or beyond the left or the right edge */
 
-                if(side == 1) color = (color >> 1) & 8355711;
-                raycast->buffer[y * raycast->win_w + x] = color;
-            }
-        }
-        else // COLORED MODE
-        {
-            /* Apply color according to the side of the wall and draw line */
+    const float x0 = (bx << SPRITE_BUCKET_SHIFT) - .5f, x1 = ((bx + 1) << SPRITE_BUCKET_SHIFT) + .5f;
+    const float y0 = (by << SPRITE_BUCKET_SHIFT) - .5f, y1 = ((by + 1) << SPRITE_BUCKET_SHIFT) + .5f;
+    const float corners[4][2] = { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
 
-            RGB color;
+    int behind = 0, left = 0, right = 0;
 
-            for (unsigned i = 0; i < raycast->map->wall_num; i++)
-                if (raycast->map->data[on_map_pos_x][on_map_pos_y] == i+1) {
-                    memcpy(color, raycast->map->wall_color[i], sizeof(RGB));
-                    break;
-                }
+    for (int i = 0; i < 4; i++)
+    {
+        const float sprite_x = corners[i][0] - raycast->pos_x;
+        const float sprite_y = corners[i][1] - raycast->pos_y;
 
-            if (side == 1) for (unsigned i = 0; i < 3; i++)
-                if (color[i] > 0) color[i] /= 2;
+        const float transform_x = inv_det * (raycast->dir_y * sprite_x - raycast->dir_x * sprite_y);
+        const float transform_y = inv_det * (-raycast->plane_y * sprite_x + raycast->plane_x * sprite_y);
 
-            SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
-            SDL_RenderDrawLine(renderer, x, draw_start, x, draw_end);
-        }
+        behind += transform_y <= 0;
+        left += transform_x < -transform_y;
+        right += transform_x > transform_y;
     }
+
+    return behind < 4 && left < 4 && right < 4;
 }
 
-void _render_buffer(SDL_Renderer* renderer, Raycast_Data* raycast) // this function renders the buffer for the textured mode
+int _compare_sprite_views(const void* a, const void* b)
 {
-    SDL_UpdateTexture(raycast->tex_render, NULL, raycast->buffer, raycast->win_w * sizeof(uint32_t));
-    SDL_RenderCopy(renderer, raycast->tex_render, NULL, NULL);
-
-    for(int x = 0; x < raycast->win_w; x++) {
-        for(int y = 0; y < raycast->win_h; y++) {
-            raycast->buffer[y * raycast->win_w + x] = 0;
-        }
-    }
+    const float da = ((const struct _Raycast_SpriteView*)a)->depth;
+    const float db = ((const struct _Raycast_SpriteView*)b)->depth;
+    return (da > db) - (da < db);
 }
 
-void _render_map(SDL_Renderer* renderer, const Raycast_Data* raycast)
+void _view_sprite(Raycast_Data* raycast, const float inv_det, const uint32_t id, uint32_t* visible)
 {
-    const int tile_size = 10;
-    const int map_pos_x = (raycast->win_w - raycast->map->width*tile_size) / 2;
-    const int map_pos_y = (raycast->win_h - raycast->map->height*tile_size) / 2;
-    const int on_map_pos_x = map_pos_x + floor(raycast->pos_x) * tile_size;
-    const int on_map_pos_y = map_pos_y + floor(raycast->pos_y) * tile_size;
+    const Sprite* sprite = &raycast->sprites->sprites[id];
 
-    Map_Render(
-        raycast->map,
-        renderer,
-        map_pos_x,
-        map_pos_y,
-        tile_size,
-        SDL_FALSE
-    );
+    if (!_is_sprite_visible(raycast, sprite)) return;
 
-    const SDL_Rect player_pos = {
-        on_map_pos_x, on_map_pos_y, 10, 10
-    };
+    /* translate sprite position to relative to camera, and transform it with the inverse camera matrix */
 
-    SDL_RenderFillRect(renderer, &player_pos);
+    const float sprite_x = sprite->x - raycast->pos_x;
+    const float sprite_y = sprite->y - raycast->pos_y;
+
+    const float transform_y = inv_det * (-raycast->plane_y * sprite_x + raycast->plane_x * sprite_y); // this is actually the depth inside the screen
+    if (transform_y <= .1f) return;
+
+    raycast->sprite_views[(*visible)++] = (struct _Raycast_SpriteView){
+        transform_y, inv_det * (raycast->dir_y * sprite_x - raycast->dir_x * sprite_y), id
+    };
 }
 
-void _render_fps(SDL_Renderer* renderer, Raycast_Data* raycast, const Clock* clock)
+void _casting_sprites(Raycast_Data* raycast) // sprites are drawn front to back, each pixel only once, behind the walls depth
 {
-    snprintf(raycast->text_frame_rate.str, 8, "FPS: %d", clock->fps);
+    const SpriteSet* set = raycast->sprites;
 
-    Text_Render(renderer,
-        raycast->text_frame_rate,
-        raycast->main_font,
-        (SDL_Color){255,255,0,255},
-        SDL_TRUE
+    const float pitch = raycast->pitch * raycast->render_scale;
+    const float pos_z = raycast->pos_z * raycast->render_scale;
+
+    /* required for correct matrix multiplication (inverse of the camera matrix) */
+
+    const float inv_det = 1.f / (raycast->plane_x * raycast->dir_y - raycast->dir_x * raycast->plane_y);
+
+    /* Culling: buckets out of the view frustum, then sprites in cells not crossed by any ray */
+
+    uint32_t visible = 0;
+
+    if (set->dirty) // changed since Sprite_Commit, the buckets are out of date so every sprite is tested
+    {
+        for (uint32_t id = 0; id < set->count; id++)
+            _view_sprite(raycast, inv_det, id, &visible);
+    }
+    else for (int by = 0; by < set->buckets_h; by++) for (int bx = 0; bx < set->buckets_w; bx++)
+    {
+        const uint32_t bucket = by * set->buckets_w + bx;
+        if (set->bucket_start[bucket] == set->bucket_start[bucket + 1]) continue;
+        if (!_is_bucket_in_frustum(raycast, inv_det, bx, by)) continue;
+
+        for (uint32_t i = set->bucket_start[bucket]; i < set->bucket_start[bucket + 1]; i++)
+            _view_sprite(raycast, inv_det, set->bucket_items[i], &visible);
+    }
+
+    qsort(raycast->sprite_views, visible, sizeof(struct _Raycast_SpriteView), _compare_sprite_views);
+
+    /* The stamp marks the pixels already covered by a nearer sprite this frame, it is only cleared when it wraps */
+
+    if (++raycast->stamp == 0) {
+        memset(raycast->sprite_stamp, 0, raycast->win_w * raycast->win_h);
+        raycast->stamp = 1;
+    }
+
+    const TexGroup* tex = raycast->sprite_tex;
+
+    for (uint32_t i = 0; i < visible; i++)
+    {
+        const struct _Raycast_SpriteView* view = &raycast->sprite_views[i];
+        const uint16_t tex_num = set->sprites[view->id].tex % tex->length;
+
+        // palettized mode: the sprites are shaded like the walls, then written after the expansion of the frame
+        const Pixel* pixels = raycast->palette ? NULL : tex->pixels[tex_num];
+        const uint8_t* indices = raycast->palette ? tex->indices[tex_num] : NULL;
+        const Sprite* sprite = &set->sprites[view->id];
+        const uint8_t light = _cell_light(raycast, (int)sprite->x, (int)sprite->y);
+        const uint8_t* shade = raycast->palette ? _shade_colormap(raycast, view->depth, 0, light) : NULL;
+
+        const int sprite_screen_x = (int)(raycast->h_render_w * (1 + view->transform_x / view->depth));
+        const int v_move_screen = (int)(pitch + pos_z / view->depth); // same vertical offsets as the walls
+
+        /* calculate height and width of the sprite on screen, using the height to keep the aspect of the walls */
+
+        const int sprite_height = abs((int)(raycast->render_h / view->depth));
+        const int sprite_width = sprite_height;
+        if (sprite_height == 0) continue;
+
+        /* calculate lowest and highest pixel to fill in current stripe */
+
+        int draw_start_y = -sprite_height / 2 + raycast->h_render_h + v_move_screen;
+        if (draw_start_y < 0) draw_start_y = 0;
+        int draw_end_y = sprite_height / 2 + raycast->h_render_h + v_move_screen;
+        if (draw_end_y >= raycast->render_h) draw_end_y = raycast->render_h - 1;
+
+        const int left_x = -sprite_width / 2 + sprite_screen_x;
+        int draw_start_x = left_x;
+        if (draw_start_x < 0) draw_start_x = 0;
+        int draw_end_x = sprite_width / 2 + sprite_screen_x;
+        if (draw_end_x >= raycast->render_w) draw_end_x = raycast->render_w - 1;
+
+        for (int stripe = draw_start_x; stripe < draw_end_x; stripe++)
+        {
+            /* depth test against the wall of this column */
+
+            if (view->depth >= raycast->z_buffer[stripe]) continue;
+
+            const int tex_x = (int)(256 * (stripe - left_x) * tex->w / sprite_width) / 256;
+
+            // behind low walls, only the rows above the farthest one in front of the sprite are seen
+            const int low_end = _low_wall_clip(raycast, stripe, view->depth);
+            const int end_y = low_end < draw_end_y ? low_end : draw_end_y;
+
+            for (int y = draw_start_y; y < end_y; y++)
+            {
+                const int p = y * raycast->render_w + stripe;
+                if (raycast->sprite_stamp[p] == raycast->stamp) continue; // a nearer sprite is already there
+
+                const int d = (y - v_move_screen) * 256 - raycast->render_h * 128 + sprite_height * 128; // 256 and 128 factors to avoid floats
+                const int tex_y = ((d * tex->h) / sprite_height) / 256;
+
+                Pixel color;
+
+                if (indices) {
+                    const uint8_t index = indices[tex->w * tex_y + tex_x];
+                    if (index == 0) continue; // black is transparent
+                    color = raycast->palette->colors[shade[index]];
+                }
+                else {
+                    color = pixels[tex->w * tex_y + tex_x];
+                    if ((color & 0x00FFFFFF) == 0) continue; // black is transparent
+                    if (light != 255) color = _light_pixel(color, light);
+                }
+
+                raycast->buffer[y * raycast->stride + stripe] = color;
+                raycast->sprite_stamp[p] = raycast->stamp;
+            }
+        }
+    }
+}
+
+void _expand_index_buffer(Raycast_Data* raycast) // palettized mode, the only per pixel work is a lookup
+{
+    const Pixel* colors = raycast->palette->colors;
+
+    for (int y = 0; y < raycast->render_h; y++)
+    {
+        const uint8_t* src = raycast->index_buffer + y * raycast->render_w;
+        uint32_t* dst = raycast->buffer + y * raycast->stride;
+
+        if (raycast->kernels.cpu->expand) raycast->kernels.cpu->expand(dst, src, colors, raycast->render_w);
+        else for (int x = 0; x < raycast->render_w; x++)
+            dst[x] = colors[src[x]];
+    }
+}
+
+void _convert_textures(Raycast_Data* raycast) // to the palette of the raycaster, the shared textures are replaced by indexed copies
+{
+    if (raycast->floor_tex) raycast->floor_tex = Palette_ConvertTexture(raycast->palette, (Texture*)raycast->floor_tex);
+    if (raycast->ceiling_tex) raycast->ceiling_tex = Palette_ConvertTexture(raycast->palette, (Texture*)raycast->ceiling_tex);
+    if (raycast->wall_tex) raycast->wall_tex = Palette_ConvertTexGroup(raycast->palette, (TexGroup*)raycast->wall_tex);
+    if (raycast->sprite_tex) raycast->sprite_tex = Palette_ConvertTexGroup(raycast->palette, (TexGroup*)raycast->sprite_tex);
+    if (raycast->materials) raycast->materials = Palette_ConvertTexGroup(raycast->palette, (TexGroup*)raycast->materials);
+}
+
+void _render_buffer(SDL_Renderer* renderer, Raycast_Data* raycast) // this function renders the buffer for the textured mode
+{
+    // only the part of the texture matching the internal resolution is updated, SDL_RenderCopy upscales it to the window
+    const SDL_Rect area = { 0, 0, raycast->render_w, raycast->render_h };
+
+    // the buffer isn't cleared after it, the floor and ceiling pass writes every pixel of the next frame
+    SDL_UpdateTexture(raycast->tex_render, &area, raycast->buffer, raycast->stride * sizeof(uint32_t));
+    SDL_RenderCopy(renderer, raycast->tex_render, &area, NULL);
+}
+
+void _set_pose(Raycast_Data* raycast, const Raycast_Pose* pose)
+{
+    raycast->pos_x = pose->pos_x, raycast->pos_y = pose->pos_y;
+    raycast->pos_z = pose->pos_z, raycast->pitch = pose->pitch;
+    raycast->dir_x = pose->dir_x, raycast->dir_y = pose->dir_y;
+    raycast->plane_x = pose->plane_x, raycast->plane_y = pose->plane_y;
+}
+
+Raycast_Pose _get_pose(const Raycast_Data* raycast)
+{
+    return (Raycast_Pose){
+        raycast->pos_x, raycast->pos_y,
+        raycast->pos_z, raycast->pitch,
+        raycast->dir_x, raycast->dir_y,
+        raycast->plane_x, raycast->plane_y
+    };
+}
+
+Raycast_Pose _interpolate_pose(const Raycast_Pose* prev, const Raycast_Pose* pose, const float alpha)
+{
+    Raycast_Pose result = *pose;
+
+    result.pos_x = prev->pos_x + (pose->pos_x - prev->pos_x) * alpha;
+    result.pos_y = prev->pos_y + (pose->pos_y - prev->pos_y) * alpha;
+    result.pos_z = prev->pos_z + (pose->pos_z - prev->pos_z) * alpha;
+    result.pitch = prev->pitch + (pose->pitch - prev->pitch) * alpha;
+
+    /* The direction and the plane are turned back by a part of the angle between both poses, so they keep their lengths */
+
+    const float angle = (alpha - 1.f) * atan2f(
+        prev->dir_x * pose->dir_y - prev->dir_y * pose->dir_x,
+        prev->dir_x * pose->dir_x + prev->dir_y * pose->dir_y
     );
+
+    const float c = cosf(angle), s = sinf(angle);
+
+    result.dir_x = pose->dir_x * c - pose->dir_y * s;
+    result.dir_y = pose->dir_x * s + pose->dir_y * c;
+    result.plane_x = pose->plane_x * c - pose->plane_y * s;
+    result.plane_y = pose->plane_x * s + pose->plane_y * c;
+
+    return result;
+}
+
+uint32_t _average_color(const uint32_t a, const uint32_t b) // average of each channel without overflow
+{
+    return (((a ^ b) & 0xFEFEFEFE) >> 1) + (a & b);
+}
+
+uint32_t _interpolate_pixel(const Raycast_Data* raycast, const int x, const int y) // the left and right neighbours were cast this frame
+{
+    const uint32_t* row = raycast->buffer + y * raycast->render_w;
+
+    if (x == 0) return row[1];
+    if (x == raycast->render_w - 1) return row[x - 1];
+
+    return _average_color(row[x - 1], row[x + 1]);
+}
+
+SDL_bool _neighbours_differ(const Raycast_Data* raycast, const int x, const int y) // the left and right neighbours cast this frame are not of the same color
+{
+    const uint32_t* row = raycast->buffer + y * raycast->render_w;
+
+    if (x == 0 || x == raycast->render_w - 1) return SDL_TRUE;
+
+    int diff = 0;
+    for (int c = 0; c < 24; c += 8) diff += abs((int)((row[x - 1] >> c) & 0xFF) - (int)((row[x + 1] >> c) & 0xFF));
+
+    return diff > REPROJECT_EDGE;
+}
+
+int _reproject_column(const Raycast_Data* raycast, const int x, float* scale_y) // column of the previous frame looking in the same direction, -1 if none
+{
+    const Raycast_Pose* prev = &raycast->history_pose;
+
+    const float camera_x = 2 * x / (float)(raycast->render_w) - 1;
+    const float ray_dir_x = raycast->dir_x + raycast->plane_x * camera_x;
+    const float ray_dir_y = raycast->dir_y + raycast->plane_y * camera_x;
+
+    // solve ray_dir // prev_dir + prev_plane * prev_camera_x with 2D cross products
+    const float cross_plane = ray_dir_x * prev->plane_y - ray_dir_y * prev->plane_x;
+    const float cross_dir = ray_dir_x * prev->dir_y - ray_dir_y * prev->dir_x;
+    if (fabsf(cross_plane) < 1e-6f) return -1;
+
+    const float prev_camera_x = -cross_dir / cross_plane;
+    if (prev_camera_x < -1.f || prev_camera_x >= 1.f) return -1;
+
+    const float prev_ray_dir_x = prev->dir_x + prev->plane_x * prev_camera_x;
+    const float prev_ray_dir_y = prev->dir_y + prev->plane_y * prev_camera_x;
+
+    // Everything in a column is at a screen offset from the horizon inversely proportional to the perpendicular
+    // distance, which is measured in units of the (non normalized) ray direction. Rotating the camera changes the
+    // length of the ray direction of this column, so the previous column is scaled vertically by the ratio of lengths.
+    *scale_y = (prev_ray_dir_x * ray_dir_x + prev_ray_dir_y * ray_dir_y) / (ray_dir_x * ray_dir_x + ray_dir_y * ray_dir_y);
+    if (*scale_y <= 0) return -1; // a ray behind the previous camera also solves the equation
+
+    const int src_x = (prev_camera_x + 1.f) * raycast->render_w / 2 + .5f; // rounded, float error would shift whole columns
+    return src_x < raycast->render_w ? src_x : -1;
+}
+
+float _row_depth(const Raycast_Data* raycast, const float horizon, const float pos_z, const int y) // distance of the floor or ceiling seen on the row
+{
+    if (y > horizon) return (.5f * raycast->render_h + pos_z) / (y - horizon);
+    if (y < horizon) return (.5f * raycast->render_h - pos_z) / (horizon - y);
+    return INFINITY;
+}
+
+int _reproject_pixel(const Raycast_Data* raycast, const int x, const int column, const int y) // pixel of the history showing the same point, -1 if it was hidden or out of the frame
+{
+    const Raycast_Pose* prev = &raycast->history_pose;
+
+    const float pos_z = raycast->pos_z * raycast->render_scale;
+    const float prev_pos_z = prev->pos_z * raycast->render_scale;
+    const float horizon = raycast->h_render_h + raycast->pitch * raycast->render_scale;
+    const float prev_horizon = raycast->h_render_h + prev->pitch * raycast->render_scale;
+
+    /* Depth of the pixel: the floor or ceiling of its row if nearer than the walls of the column cast this frame */
+
+    float wall = raycast->z_buffer[column];
+
+    for (int i = 0; i < raycast->low_count[column]; i++) {
+        if (y < raycast->low_top[column * LOW_WALL_LAYERS + i]) continue;
+        wall = raycast->low_depth[column * LOW_WALL_LAYERS + i]; // the nearest low wall covering the row
+        break;
+    }
+
+    const float depth = fminf(wall, _row_depth(raycast, horizon, pos_z, y));
+
+    /* The point, relative to the previous camera, solves point = prev_depth * (prev_dir + prev_plane * prev_camera_x) */
+
+    const float camera_x = 2 * x / (float)(raycast->render_w) - 1;
+    const float point_x = raycast->pos_x + (raycast->dir_x + raycast->plane_x * camera_x) * depth - prev->pos_x;
+    const float point_y = raycast->pos_y + (raycast->dir_y + raycast->plane_y * camera_x) * depth - prev->pos_y;
+
+    const float det = prev->dir_x * prev->plane_y - prev->dir_y * prev->plane_x;
+    const float prev_depth = (point_x * prev->plane_y - point_y * prev->plane_x) / det;
+    if (prev_depth < .1f) return -1;
+
+    const float prev_camera_x = (prev->dir_x * point_y - prev->dir_y * point_x) / det / prev_depth;
+    if (prev_camera_x < -1.f || prev_camera_x >= 1.f) return -1;
+
+    // the offset of a point from the horizon times its depth only changes with the height of the eye
+    const int src_x = (prev_camera_x + 1.f) * raycast->render_w / 2 + .5f;
+    const int src_y = floorf(prev_horizon + ((y - horizon) * depth + prev_pos_z - pos_z) / prev_depth + .5f);
+    if (src_x >= raycast->render_w || src_y < 0 || src_y >= raycast->render_h) return -1;
+
+    /* Disocclusion: something else was nearer there in the previous frame (the low walls of the history are not
+       kept, the pixels seen on them are interpolated too) */
+
+    const float seen = fminf(raycast->history_depth[src_x], _row_depth(raycast, prev_horizon, prev_pos_z, src_y));
+    if (fabsf(seen - prev_depth) > prev_depth * REPROJECT_TOLERANCE) return -1;
+
+    const int src = src_y * raycast->render_w + src_x;
+    if (raycast->sprites && raycast->sprite_stamp[src] == raycast->stamp) return -1; // the sprites are drawn again where they are now
+
+    return src;
+}
+
+void _reconstruct_frame(Raycast_Data* raycast) // fills the pixels skipped by the interlaced casting
+{
+    const Raycast_Pose* prev = &raycast->history_pose;
+
+    /* A pure rotation maps whole columns of the history, a translation moves the parallax: each pixel is then placed
+       at the depth of its column and projected in the previous frame. Where the cast neighbours agree the interpolation
+       is closer than a history pixel rounded to the nearest, so only the edges and the texture details are reprojected */
+
+    const SDL_bool rotation = prev->pos_x == raycast->pos_x
+                           && prev->pos_y == raycast->pos_y
+                           && prev->pos_z == raycast->pos_z;
+
+    const float horizon = raycast->h_render_h + raycast->pitch * raycast->render_scale;
+    const float prev_horizon = raycast->h_render_h + prev->pitch * raycast->render_scale;
+
+    const SDL_bool checkerboard = raycast->interlace == INTERLACE_CHECKERBOARD;
+    const int x_first = checkerboard ? 0 : !raycast->field;
+    const int x_step = checkerboard ? 1 : 2;
+    const int y_step = checkerboard ? 2 : 1;
+
+    for (int x = x_first; x < raycast->render_w; x += x_step)
+    {
+        float scale_y = 1.f;
+        const int src_x = rotation ? _reproject_column(raycast, x, &scale_y) : -1;
+        const int y_first = checkerboard ? (x + raycast->field + 1) & 1 : 0;
+
+        // a skipped column takes the depth of a neighbour cast this frame, the nearer one first
+        int near = x, far = x;
+
+        if (!checkerboard) {
+            near = x > 0 ? x - 1 : x + 1, far = x < raycast->render_w - 1 ? x + 1 : x - 1;
+            if (raycast->z_buffer[far] < raycast->z_buffer[near]) near = far, far = x > 0 ? x - 1 : x + 1;
+        }
+
+        for (int y = y_first; y < raycast->render_h; y += y_step)
+        {
+            int src = -1;
+
+            if (rotation) {
+                const int src_y = floorf(prev_horizon + (y - horizon) * scale_y + .5f);
+                if (src_x >= 0 && src_y >= 0 && src_y < raycast->render_h) src = src_y * raycast->render_w + src_x;
+            }
+            else if (_neighbours_differ(raycast, x, y) && (src = _reproject_pixel(raycast, x, near, y)) < 0 && far != near) {
+                src = _reproject_pixel(raycast, x, far, y);
+            }
+
+            raycast->buffer[y * raycast->render_w + x] = src >= 0 ? raycast->history[src] : _interpolate_pixel(raycast, x, y);
+        }
+
+        // the skipped column keeps the depth of its nearer neighbour, for the sprites and the next reprojection
+        if (!checkerboard) {
+            raycast->z_buffer[x] = raycast->z_buffer[near];
+            _copy_low_walls(raycast, x, near);
+        }
+    }
+}
+
+void _store_history(Raycast_Data* raycast) // the finished frame becomes the history of the next one
+{
+    uint32_t* tmp = raycast->history;
+    raycast->history = raycast->buffer;
+    raycast->buffer = tmp;
+
+    raycast->history_pose = _get_pose(raycast);
+    raycast->history_valid = SDL_TRUE;
+    raycast->field = !raycast->field;
+
+    memcpy(raycast->history_depth, raycast->z_buffer, raycast->render_w * sizeof(float));
+}
+
+void _cast_frame(Raycast_Data* raycast) // casts the whole frame of the textured mode in the buffer
+{
+    const SDL_bool partial = raycast->interlace && raycast->history_valid;
+
+    _casting_textured_floor_ceiling(raycast);
+    _casting_walls(NULL, raycast);
+    if (raycast->palette) _expand_index_buffer(raycast);
+    if (partial) _reconstruct_frame(raycast);
+    if (raycast->sprites) _casting_sprites(raycast);
+}
+
+SDL_bool _render_zero_copy(SDL_Renderer* renderer, Raycast_Data* raycast) // casts straight in the render texture, SDL_FALSE if it can't be locked
+{
+    const SDL_Rect area = { 0, 0, raycast->render_w, raycast->render_h };
+
+    void* pixels;
+    int pitch;
+
+    if (SDL_LockTexture(raycast->tex_render, &area, &pixels, &pitch) != 0) return SDL_FALSE;
+
+    /* The locked memory is write-only and its content undefined, every pixel is written by the frame */
+
+    uint32_t* buffer = raycast->buffer;
+    raycast->buffer = pixels;
+    raycast->stride = pitch / sizeof(uint32_t);
+
+    _cast_frame(raycast);
+
+    raycast->buffer = buffer;
+    raycast->stride = raycast->render_w;
+
+    SDL_UnlockTexture(raycast->tex_render);
+    SDL_RenderCopy(renderer, raycast->tex_render, &area, NULL);
+
+    return SDL_TRUE;
+}
+
+void _apply_render_scale(Raycast_Data* raycast, float scale)
+{
+    /* Quantize the scale so that the resolution does not change for every small variation */
+
+    scale = roundf(fminf(fmaxf(scale, 1.f / RENDER_SCALE_STEPS), 1.f) * RENDER_SCALE_STEPS) / RENDER_SCALE_STEPS;
+
+    /* The buffer and the render texture stay allocated at the window size, only the used part changes */
+
+    raycast->render_w = fmaxf(1.f, roundf(raycast->win_w * scale));
+    raycast->render_h = fmaxf(1.f, roundf(raycast->win_h * scale));
+    raycast->h_render_w = raycast->render_w / 2;
+    raycast->h_render_h = raycast->render_h / 2;
+
+    raycast->render_scale = (float)raycast->render_h / raycast->win_h;
+    raycast->stride = raycast->render_w;
+    raycast->history_valid = SDL_FALSE; // history has not the same resolution anymore
+}
+
+void _update_render_scale(Raycast_Data* raycast, const float cost_ms)
+{
+    struct _Raycast_Scaler* scaler = &raycast->scaler;
+
+    scaler->cost_ms += (cost_ms - scaler->cost_ms) * .1f; // exponential moving average of the last frames
+
+    if (scaler->target_ms <= 0) return;
+    if (scaler->cooldown > 0) { scaler->cooldown--; return; }
+
+    /* The cost is roughly proportional to the number of pixels, therefore to the square of the scale */
+
+    const float ratio = sqrtf(scaler->target_ms / fmaxf(scaler->cost_ms, .01f));
+    const float step = 1.f / RENDER_SCALE_STEPS; // at least one step each way, else the quantization cancels the small moves
+    float scale = raycast->render_scale;
+
+    if (scaler->cost_ms > scaler->target_ms) scale = fminf(scale * ratio, scale - step);                          // over budget, drop quickly
+    else if (scaler->cost_ms < .8f * scaler->target_ms) scale = fmaxf(scale * fminf(ratio, 1.05f), scale + step); // well under budget, climb slowly
+    else return;
+
+    scale = fminf(fmaxf(scale, scaler->min_scale), scaler->max_scale);
+
+    const float old_scale = raycast->render_scale;
+    _apply_render_scale(raycast, scale);
+
+    if (raycast->render_scale != old_scale) {
+        scaler->cost_ms *= (raycast->render_scale * raycast->render_scale) / (old_scale * old_scale); // predicted cost at the new scale
+        scaler->cooldown = RENDER_SCALE_COOLDOWN;
+    }
+}
+
+Pixel _map_color(const Map* map, const int x, const int y) // same colors as Map_Render
+{
+    const uint8_t cell = map->data[x][y];
+    if (!cell || cell > map->wall_num) return 0xFF3F3F3F;
+
+    const uint8_t* color = map->wall_color[cell-1];
+    return 0xFF000000 | color[0] << 16 | color[1] << 8 | color[2];
+}
+
+void _update_minimap(SDL_Renderer* renderer, Raycast_Data* raycast)
+{
+    /* The minimap is cached in a texture of one texel per cell, only the cells edited since the last update are uploaded */
+
+    const Map* map = raycast->map;
+    SDL_Rect rect;
+
+    if (!raycast->tex_map) {
+        raycast->tex_map = SDL_CreateTexture(renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            map->width + 1, map->height + 1
+        );
+        rect = (SDL_Rect){ 0, 0, map->width + 1, map->height + 1 };
+    }
+    else if (!Map_GetDirty(map, raycast->map_generation, &rect)) return;
+
+    Pixel* pixels = malloc(sizeof(Pixel) * rect.w * rect.h);
+
+    for (int y = 0; y < rect.h; y++)
+        for (int x = 0; x < rect.w; x++)
+            pixels[y * rect.w + x] = _map_color(map, rect.x + x, rect.y + y);
+
+    SDL_UpdateTexture(raycast->tex_map, &rect, pixels, rect.w * sizeof(Pixel));
+    free(pixels);
+
+    raycast->map_generation = map->generation;
+}
+
+void _render_map(SDL_Renderer* renderer, Raycast_Data* raycast)
+{
+    const int tile_size = 10;
+    const int map_pos_x = (raycast->win_w - raycast->map->width*tile_size) / 2;
+    const int map_pos_y = (raycast->win_h - raycast->map->height*tile_size) / 2;
+    const int on_map_pos_x = map_pos_x + floor(raycast->pos_x) * tile_size;
+    const int on_map_pos_y = map_pos_y + floor(raycast->pos_y) * tile_size;
+
+    _update_minimap(renderer, raycast);
+
+    const SDL_Rect map_rect = {
+        map_pos_x, map_pos_y,
+        tile_size * (raycast->map->width + 1),
+        tile_size * (raycast->map->height + 1)
+    };
+
+    SDL_RenderCopy(renderer, raycast->tex_map, NULL, &map_rect);
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderDrawRect(renderer, &map_rect);
+
+    const SDL_Rect player_pos = {
+        on_map_pos_x, on_map_pos_y, 10, 10
+    };
+
+    SDL_RenderFillRect(renderer, &player_pos);
+}
+
+void _render_fps(SDL_Renderer* renderer, Raycast_Data* raycast, const Clock* clock)
+{
+    // the text is only rendered again when the frame rate (once per second at most, see Clock_Update) or the latency in ms change
+
+    const int latency = (int)(raycast->latency_ms + .5f);
+
+    if (!raycast->tex_frame_rate || clock->fps != raycast->frame_rate || latency != raycast->frame_latency)
+    {
+        if (raycast->tex_frame_rate) SDL_DestroyTexture(raycast->tex_frame_rate);
+
+        if (raycast->latency_ms > 0.f) snprintf(raycast->text_frame_rate.str, FPS_TEXT_SIZE, "FPS: %d  input: %d ms", clock->fps, latency);
+        else snprintf(raycast->text_frame_rate.str, FPS_TEXT_SIZE, "FPS: %d", clock->fps);
+
+        raycast->tex_frame_rate = Text_Bake(renderer, &raycast->text_frame_rate, raycast->main_font, (SDL_Color){255,255,0,255});
+        raycast->frame_rate = clock->fps;
+        raycast->frame_latency = latency;
+    }
+
+    const Text* text = &raycast->text_frame_rate;
+    SDL_RenderCopy(renderer, raycast->tex_frame_rate, NULL, &(SDL_Rect){ (int)text->x, (int)text->y, text->w, text->h });
+}
+
+size_t _arena_capacity(const uint16_t win_w, const uint16_t win_h) // every block the raycaster can take from its arena
+{
+    const size_t pixels = (size_t)win_w * win_h;
+    size_t capacity = 0;
+
+    capacity = Arena_Reserve(capacity, sizeof(Raycast_Data), ARENA_LINE);
+    capacity = Arena_Reserve(capacity, FPS_TEXT_SIZE, ARENA_LINE);
+
+    capacity = Arena_Reserve(capacity, pixels * sizeof(uint32_t), ARENA_PAGE);  // buffer
+    capacity = Arena_Reserve(capacity, pixels * sizeof(uint32_t), ARENA_PAGE);  // history
+    capacity = Arena_Reserve(capacity, pixels, ARENA_PAGE);                     // index_buffer
+    capacity = Arena_Reserve(capacity, pixels, ARENA_PAGE);                     // sprite_stamp
+
+    capacity = Arena_Reserve(capacity, win_w * sizeof(float), ARENA_LINE);      // z_buffer
+    capacity = Arena_Reserve(capacity, win_w * sizeof(float), ARENA_LINE);      // history_depth
+    capacity = Arena_Reserve(capacity, win_w * LOW_WALL_LAYERS * sizeof(float), ARENA_LINE);    // low_depth
+    capacity = Arena_Reserve(capacity, win_w * LOW_WALL_LAYERS * sizeof(int16_t), ARENA_LINE);  // low_top
+    capacity = Arena_Reserve(capacity, win_w, ARENA_LINE);                                      // low_count
+
+    return capacity;
+}
+
+uint32_t* _alloc_history(Raycast_Data* raycast) // the block is kept by the arena when the history is released, see _release_history
+{
+    if (raycast->spare_buffer) {
+        uint32_t* history = raycast->spare_buffer;
+        raycast->spare_buffer = NULL;
+        return history;
+    }
+
+    return Arena_Alloc(raycast->arena, raycast->win_w * raycast->win_h * sizeof(uint32_t), ARENA_PAGE);
+}
+
+void _release_history(Raycast_Data* raycast)
+{
+    raycast->spare_buffer = raycast->history; // may be the first buffer, swapped by the pipeline
+    raycast->history = NULL;
+}
+
+void _alloc_buffers(SDL_Renderer* renderer, Raycast_Data* raycast) // buffers of the textured mode
+{
+    // the per column arrays are read together by the sprites, they follow each other in the arena
+
+    raycast->buffer = Arena_Alloc(raycast->arena, raycast->win_w * raycast->win_h * sizeof(uint32_t), ARENA_PAGE);
+    raycast->z_buffer = Arena_Alloc(raycast->arena, raycast->win_w * sizeof(float), ARENA_LINE);
+    raycast->history_depth = Arena_Alloc(raycast->arena, raycast->win_w * sizeof(float), ARENA_LINE);
+    raycast->low_depth = Arena_Alloc(raycast->arena, raycast->win_w * LOW_WALL_LAYERS * sizeof(float), ARENA_LINE);
+    raycast->low_top = Arena_Alloc(raycast->arena, raycast->win_w * LOW_WALL_LAYERS * sizeof(int16_t), ARENA_LINE);
+    raycast->low_count = Arena_Alloc(raycast->arena, raycast->win_w, ARENA_LINE);
+
+    raycast->tex_render = SDL_CreateTexture(renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        raycast->win_w, raycast->win_h
+    );
+}
+
+/* TEXTURE RELOAD functions */
+
+struct _Raycast_Reload {
+    SDL_Thread* thread;
+    SDL_atomic_t done;          // set by the loader thread once the textures are decoded (or failed)
+
+    char* floor_path;           // copies of the paths, NULL keeps the current texture
+    char* ceiling_path;
+    char** wall_paths;
+    unsigned wall_num;
+    const Palette* palette;     // of the raycaster at the request, the textures are converted by the loader thread too
+
+    Texture* floor_tex;
+    Texture* ceiling_tex;
+    TexGroup* wall_tex;
+    SDL_bool failed;
+};
+
+char* _copy_path(const char* path)
+{
+    if (!path) return NULL;
+
+    char* copy = malloc(strlen(path) + 1);
+    strcpy(copy, path);
+    return copy;
+}
+
+int _reload_worker(void* data) // decodes all the textures, nothing of the raycaster is touched here
+{
+    struct _Raycast_Reload* reload = data;
+
+    if (reload->floor_path) reload->failed |= !(reload->floor_tex = Texture_TryLoad(reload->floor_path));
+    if (reload->ceiling_path) reload->failed |= !(reload->ceiling_tex = Texture_TryLoad(reload->ceiling_path));
+    if (reload->wall_paths) reload->failed |= !(reload->wall_tex = TexGroup_TryLoad((const char**)reload->wall_paths, reload->wall_num));
+
+    if (reload->palette && !reload->failed) {
+        if (reload->floor_tex) reload->floor_tex = Palette_ConvertTexture(reload->palette, reload->floor_tex);
+        if (reload->ceiling_tex) reload->ceiling_tex = Palette_ConvertTexture(reload->palette, reload->ceiling_tex);
+        if (reload->wall_tex) reload->wall_tex = Palette_ConvertTexGroup(reload->palette, reload->wall_tex);
+    }
+
+    SDL_AtomicSet(&reload->done, 1);
+    return 0;
+}
+
+void _free_reload(struct _Raycast_Reload* reload) // the textures left in it were not swapped in
+{
+    if (reload->thread) SDL_WaitThread(reload->thread, NULL);
+
+    if (reload->floor_tex) Texture_Free(reload->floor_tex);
+    if (reload->ceiling_tex) Texture_Free(reload->ceiling_tex);
+    if (reload->wall_tex) TexGroup_Destroy(reload->wall_tex);
+
+    free(reload->floor_path);
+    free(reload->ceiling_path);
+    for (unsigned i = 0; reload->wall_paths && i < reload->wall_num; i++) free(reload->wall_paths[i]);
+    free(reload->wall_paths);
+    free(reload);
+}
+
+void _swap_reloaded_textures(Raycast_Data* raycast) // at a frame boundary, the render thread (if any) must be idle
+{
+    struct _Raycast_Reload* reload = raycast->reload;
+    if (!reload || !SDL_AtomicGet(&reload->done)) return;
+
+    SDL_WaitThread(reload->thread, NULL); // already finished
+    reload->thread = NULL;
+    raycast->reload = NULL;
+
+    /* All or nothing: the textures are only swapped in if every one of them was loaded */
+
+    if (reload->failed) {
+        fprintf(stderr, "ERROR of Raycast_ReloadTex: A texture could not be loaded, the current ones are kept.\n");
+    }
+    else if (reload->wall_tex && reload->wall_tex->length < raycast->map->wall_num) {
+        fprintf(stderr, "ERROR of Raycast_ReloadTex: %u wall textures for %u kinds of walls, the current ones are kept.\n",
+            reload->wall_tex->length, raycast->map->wall_num);
+    }
+    else {
+        if (reload->floor_tex) {
+            if (raycast->floor_tex) Texture_Free((Texture*)raycast->floor_tex);
+            raycast->floor_tex = reload->floor_tex, reload->floor_tex = NULL;
+        }
+        if (reload->ceiling_tex) {
+            if (raycast->ceiling_tex) Texture_Free((Texture*)raycast->ceiling_tex);
+            raycast->ceiling_tex = reload->ceiling_tex, reload->ceiling_tex = NULL;
+        }
+        if (reload->wall_tex) {
+            if (raycast->wall_tex) TexGroup_Destroy((TexGroup*)raycast->wall_tex);
+            raycast->wall_tex = reload->wall_tex, reload->wall_tex = NULL;
+        }
+
+        if (raycast->palette) _convert_textures(raycast); // if the palette was loaded after the request
+        _select_kernels(raycast);
+    }
+
+    _free_reload(reload);
+}
+
+/* BATCH RENDERING functions */
+
+struct _Raycast_Batch {
+    const Raycast_Data* raycast;
+    const Raycast_Pose* poses;
+    uint32_t** framebuffers;
+    unsigned count;
+    uint16_t w, h;
+    SDL_atomic_t next;      // index of the next pose to render, shared by the workers
+};
+
+struct _Raycast_BatchPool {
+    SDL_sem* start;                 // posted once for each worker a batch needs
+    SDL_sem* done;                  // posted by each worker when the poses are all taken
+    SDL_atomic_t quit;
+    struct _Raycast_Batch* batch;   // in progress, set before the start is posted
+    unsigned count;                 // workers, the calling thread included
+    size_t scratch_size;
+
+    struct _Raycast_BatchWorker {
+        struct _Raycast_BatchPool* pool;
+        SDL_Thread* thread;         // NULL for the calling thread
+        uint8_t* scratch;           // index buffer of the palettized mode, kept from a batch to the next
+    } workers[BATCH_MAX_THREADS];
+};
+
+void _batch_worker(struct _Raycast_Batch* batch, uint8_t* scratch)
+{
+    /* Each worker casts with its own copy of the raycaster, which still points to the shared map and textures */
+
+    Raycast_Data view = *batch->raycast;
+
+    view.win_w = view.render_w = batch->w;
+    view.win_h = view.render_h = batch->h;
+    view.h_win_w = view.h_render_w = batch->w / 2;
+    view.h_win_h = view.h_render_h = batch->h / 2;
+    view.render_scale = 1.f;
+    view.stride = batch->w;
+
+    view.interlace = INTERLACE_OFF;
+    view.history = NULL;
+    view.history_valid = SDL_FALSE;
+
+    // the per-frame buffers of the raycaster can't be shared between the workers
+    view.z_buffer = NULL;
+    view.low_count = NULL;
+    view.vis_cells = NULL;
+    view.vis_faces = NULL;
+    view.sprites = NULL;
+    view.index_buffer = view.palette ? scratch : NULL;
+
+    /* Poses are taken by chunks to balance the load without contending on the counter */
+
+    for (;;)
+    {
+        const unsigned first = SDL_AtomicAdd(&batch->next, BATCH_CHUNK);
+        if (first >= batch->count) break;
+
+        const unsigned last = first + BATCH_CHUNK < batch->count ? first + BATCH_CHUNK : batch->count;
+
+        for (unsigned i = first; i < last; i++)
+        {
+            _set_pose(&view, &batch->poses[i]);
+            view.buffer = batch->framebuffers[i];
+
+            _casting_textured_floor_ceiling(&view);
+            _casting_walls(NULL, &view);
+            if (view.palette) _expand_index_buffer(&view);
+        }
+    }
+}
+
+int _batch_thread(void* data) // sleeps between the batches
+{
+    struct _Raycast_BatchWorker* worker = data;
+    struct _Raycast_BatchPool* pool = worker->pool;
+
+    for (;;)
+    {
+        SDL_SemWait(pool->start);
+        if (SDL_AtomicGet(&pool->quit)) break;
+
+        _batch_worker(pool->batch, worker->scratch);
+        SDL_SemPost(pool->done);
+    }
+
+    return 0;
+}
+
+struct _Raycast_BatchPool* _create_batch_pool(const unsigned threads) // 0 for one worker per CPU core
+{
+    struct _Raycast_BatchPool* pool = malloc(sizeof(struct _Raycast_BatchPool));
+
+    pool->count = threads ? threads : (unsigned)SDL_GetCPUCount();
+    if (pool->count > BATCH_MAX_THREADS) pool->count = BATCH_MAX_THREADS;
+    if (pool->count < 1) pool->count = 1;
+
+    pool->start = SDL_CreateSemaphore(0);
+    pool->done = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&pool->quit, 0);
+    pool->batch = NULL;
+    pool->scratch_size = 0;
+
+    for (unsigned i = 0; i < pool->count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].scratch = NULL;
+        pool->workers[i].thread = i ? SDL_CreateThread(_batch_thread, "raycast_batch", &pool->workers[i]) : NULL;
+    }
+
+    return pool;
+}
+
+void _free_batch_pool(struct _Raycast_BatchPool* pool)
+{
+    SDL_AtomicSet(&pool->quit, 1);
+
+    for (unsigned i = 1; i < pool->count; i++) SDL_SemPost(pool->start);
+
+    for (unsigned i = 0; i < pool->count; i++) {
+        if (pool->workers[i].thread) SDL_WaitThread(pool->workers[i].thread, NULL);
+        free(pool->workers[i].scratch);
+    }
+
+    SDL_DestroySemaphore(pool->start);
+    SDL_DestroySemaphore(pool->done);
+    free(pool);
+}
+
+/* PIPELINE functions */
+
+struct _Raycast_Pipeline {
+    SDL_Thread* thread;
+    SDL_sem* start;             // posted by the main thread when a frame is ready to be cast
+    SDL_sem* done;              // posted by the render thread when the frame is cast
+    SDL_atomic_t quit;
+    SDL_bool in_flight;
+    SDL_bool unshown;           // the last frame finished is in history but not uploaded yet
+
+    Raycast_Data view;          // copy of the raycaster for the frame in flight, only used by the render thread meanwhile
+    uint16_t frame_w, frame_h;  // internal resolution of the frame in flight
+    float cost_ms;
+    uint32_t input_time;        // of the oldest mouse motion shown by the frame in flight, 0 if none
+
+    /* Visibility of the frame in flight, swapped with the one of the raycaster when it is done: the queries
+       only read finished frames. The marks and bounds are the ones of the frame cast two frames ago. */
+
+    uint32_t* vis_cells;
+    uint32_t* vis_face_bits;
+    Raycast_Face* vis_faces;
+    uint32_t vis_face_count;
+    uint16_t vis_min_x, vis_min_y;
+    uint16_t vis_max_x, vis_max_y;
+    uint32_t vis_size;          // cells of the map the sets were allocated for
+};
+
+void _free_pipeline_visibility(struct _Raycast_Pipeline* pipeline)
+{
+    free(pipeline->vis_cells);
+    free(pipeline->vis_face_bits);
+    free(pipeline->vis_faces);
+    pipeline->vis_cells = NULL, pipeline->vis_face_bits = NULL, pipeline->vis_faces = NULL;
+    pipeline->vis_face_count = 0;
+}
+
+void _pipeline_visibility(Raycast_Data* raycast) // gives the sets of the pipeline to the view, allocated like the ones of the raycaster
+{
+    struct _Raycast_Pipeline* pipeline = raycast->pipeline;
+    Raycast_Data* view = &pipeline->view;
+
+    if (!raycast->vis_cells) return;
+
+    const uint32_t cells = (raycast->map->width + 1) * (raycast->map->height + 1);
+
+    if (!pipeline->vis_cells || pipeline->vis_size != cells || !pipeline->vis_faces != !raycast->vis_faces)
+    {
+        _free_pipeline_visibility(pipeline);
+
+        pipeline->vis_cells = calloc((cells + 31) / 32, sizeof(uint32_t));
+        pipeline->vis_min_x = pipeline->vis_min_y = UINT16_MAX;
+        pipeline->vis_max_x = pipeline->vis_max_y = 0;
+        pipeline->vis_size = cells;
+
+        if (raycast->vis_faces) {
+            pipeline->vis_face_bits = calloc((cells * 4 + 31) / 32, sizeof(uint32_t));
+            pipeline->vis_faces = malloc(cells * 4 * sizeof(Raycast_Face));
+        }
+    }
+
+    view->vis_cells = pipeline->vis_cells;
+    view->vis_face_bits = pipeline->vis_face_bits;
+    view->vis_faces = pipeline->vis_faces;
+    view->vis_face_count = pipeline->vis_face_count;
+    view->vis_min_x = pipeline->vis_min_x, view->vis_min_y = pipeline->vis_min_y;
+    view->vis_max_x = pipeline->vis_max_x, view->vis_max_y = pipeline->vis_max_y;
+}
+
+int _pipeline_worker(void* data)
+{
+    struct _Raycast_Pipeline* pipeline = data;
+
+    for (;;)
+    {
+        SDL_SemWait(pipeline->start);
+        if (SDL_AtomicGet(&pipeline->quit)) break;
+
+        const uint64_t start = SDL_GetPerformanceCounter();
+
+        _cast_frame(&pipeline->view); // the pose was copied with the view before the start was posted
+
+        pipeline->cost_ms = (SDL_GetPerformanceCounter() - start) * 1000.f / SDL_GetPerformanceFrequency();
+
+        SDL_SemPost(pipeline->done);
+    }
+
+    return 0;
+}
+
+void _pipeline_launch(Raycast_Data* raycast) // the next frame is cast in buffer, from the last one kept in history
+{
+    struct _Raycast_Pipeline* pipeline = raycast->pipeline;
+
+    pipeline->input_time = _latch_camera(raycast); // the render thread starts casting right after
+
+    pipeline->view = *raycast;
+    pipeline->view.pipeline = NULL;
+    _pipeline_visibility(raycast);
+    pipeline->frame_w = raycast->render_w;
+    pipeline->frame_h = raycast->render_h;
+
+    pipeline->in_flight = SDL_TRUE;
+    SDL_SemPost(pipeline->start);
+}
+
+void _render_pipelined(SDL_Renderer* renderer, Raycast_Data* raycast, const SDL_bool cast) // without cast, only the frame in flight is shown
+{
+    struct _Raycast_Pipeline* pipeline = raycast->pipeline;
+
+    // only the first frame is cast without overlap, the one finished by a sync is shown while the next one is cast
+    if (cast && !pipeline->in_flight && !pipeline->unshown) _pipeline_launch(raycast);
+
+    Raycast_SyncPipeline(raycast);
+    _swap_reloaded_textures(raycast); // the render thread is idle until the next launch
+
+    const SDL_Rect area = { 0, 0, pipeline->frame_w, pipeline->frame_h };
+    const SDL_bool upload = pipeline->unshown;
+
+    if (upload) {
+        raycast->shown_time = pipeline->input_time; // the frame cast is uploaded now
+        if (raycast->capture) Capture_Push(raycast->capture, raycast->history, area.w, area.w, area.h); // before the buffers are swapped again
+        _update_render_scale(raycast, pipeline->cost_ms);
+    }
+
+    /* The next frame is cast while the finished one is uploaded */
+
+    if (cast) _pipeline_launch(raycast);
+
+    if (upload) SDL_UpdateTexture(raycast->tex_render, &area, raycast->history, area.w * sizeof(uint32_t));
+    pipeline->unshown = SDL_FALSE;
+
+    SDL_RenderCopy(renderer, raycast->tex_render, &area, NULL);
+}
+
+/* FRAME SKIPPING functions */
+
+void _invalidate(Raycast_Data* raycast)
+{
+    raycast->redraw = raycast->interlace ? 2 : 1; // both fields of the interlaced modes
+}
+
+SDL_bool _frame_changed(const Raycast_Data* raycast, const Raycast_Pose* shown) // whether the frame cast last shows something else than now
+{
+    const uint32_t light_generation = raycast->lightmap ? raycast->lightmap->generation : 0;
+
+    return raycast->ctrl.mouse_dx || raycast->ctrl.mouse_dy     // turns the camera before the frame is cast
+        || raycast->capture                                     // the video is recorded in real time
+        || (raycast->reload && SDL_AtomicGet(&raycast->reload->done))
+        || raycast->map->generation != raycast->frame_generation
+        || light_generation != raycast->frame_light_generation
+        || raycast->render_w != raycast->frame_w || raycast->render_h != raycast->frame_h
+        || memcmp(shown, &raycast->frame_pose, sizeof(Raycast_Pose));
+}
+
+void _frame_done(Raycast_Data* raycast, const SDL_bool changed) // the pose of the raycaster is the one the frame was cast with
+{
+    raycast->frame_pose = _get_pose(raycast);
+    raycast->frame_generation = raycast->map->generation;
+    raycast->frame_light_generation = raycast->lightmap ? raycast->lightmap->generation : 0;
+    raycast->frame_w = raycast->render_w;
+    raycast->frame_h = raycast->render_h;
+
+    // an interlaced frame casts half of the pixels, the next one completes it even if nothing moves
+    if (changed && raycast->interlace) raycast->redraw = 1;
+    else if (raycast->redraw) raycast->redraw--;
 }
 
 /* PUBLIC FUNCTIONS */
 
 void Raycast_LoadMap(Raycast_Data* raycast, const Map* map, const uint16_t pos_x, const uint16_t pos_y)
 {
+    Raycast_SyncPipeline(raycast);
+
+    Map_Retain((Map*)map);
+    if (raycast->map) Map_Destroy((Map*)raycast->map);
+
     raycast->map = map;
+    raycast->lightmap = NULL; // baked for the previous map
+    _select_kernels(raycast);
+
+    if (raycast->tex_map) SDL_DestroyTexture(raycast->tex_map); // sized for the previous map
+    raycast->tex_map = NULL;
+
+    if (raycast->vis_cells) _alloc_visibility(raycast); // sized for the new map
 
     if (pos_x > 0 && pos_x <= map->width
      && pos_y > 0 && pos_y <= map->height) {
@@ -581,7 +2166,8 @@ void Raycast_LoadMap(Raycast_Data* raycast, const Map* map, const uint16_t pos_x
 
     }
 
-
+    raycast->prev_pose = _get_pose(raycast); // no interpolation from the previous map
+    _invalidate(raycast);
 }
 
 void Raycast_LoadTex(
@@ -591,26 +2177,389 @@ void Raycast_LoadTex(
     Texture* ceiling_tex,
     TexGroup* wall_tex)
 {
-    if (!raycast->buffer)
-    {
-        raycast->buffer = malloc(raycast->win_w * raycast->win_h * sizeof(uint32_t));
+    Raycast_SyncPipeline(raycast);
 
-        raycast->tex_render = SDL_CreateTexture(renderer,
-            SDL_PIXELFORMAT_ARGB8888,
-            SDL_TEXTUREACCESS_STREAMING,
-            raycast->win_w, raycast->win_h
-        );
+    if (!raycast->floor_tex && !raycast->ceiling_tex && !raycast->wall_tex)
+    {
+        if (!raycast->buffer) _alloc_buffers(renderer, raycast);
 
         raycast->floor_tex = floor_tex;
         raycast->ceiling_tex = ceiling_tex;
         raycast->wall_tex = wall_tex;
+
+        if (raycast->palette) _convert_textures(raycast);
+        _select_kernels(raycast);
+        _invalidate(raycast);
     }
     else
     {
-        fprintf(stderr, "ERROR of Raycast_LoadTex: The raycaster has already been initialized with textures.\n");
+        fprintf(stderr, "ERROR of Raycast_LoadTex: The raycaster has already been initialized with textures, see Raycast_ReloadTex.\n");
+    }
+}
+
+SDL_bool Raycast_ReloadTex(Raycast_Data* raycast, const char* floor_path, const char* ceiling_path, const char** wall_paths, const unsigned wall_num)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_ReloadTex: The textures are only used in textured mode.\n");
+        return SDL_FALSE;
+    }
+
+    if (raycast->reload) {
+        fprintf(stderr, "ERROR of Raycast_ReloadTex: The textures of the previous reload have not been swapped in yet.\n");
+        return SDL_FALSE;
+    }
+
+    struct _Raycast_Reload* reload = calloc(1, sizeof(struct _Raycast_Reload));
+
+    reload->floor_path = _copy_path(floor_path);
+    reload->ceiling_path = _copy_path(ceiling_path);
+    reload->palette = raycast->palette;
+
+    if (wall_paths && wall_num) {
+        reload->wall_num = wall_num;
+        reload->wall_paths = malloc(wall_num * sizeof(char*));
+        for (unsigned i = 0; i < wall_num; i++) reload->wall_paths[i] = _copy_path(wall_paths[i]);
+    }
+
+    SDL_AtomicSet(&reload->done, 0);
+    raycast->reload = reload;
+    reload->thread = SDL_CreateThread(_reload_worker, "raycast_reload", reload);
+
+    return SDL_TRUE;
+}
+
+void Raycast_LoadPalette(Raycast_Data* raycast, Palette* palette, const float fog)
+{
+    Raycast_SyncPipeline(raycast);
+
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_LoadPalette: The palettized mode is only available in textured mode.\n");
+        Palette_Free(palette);
+        return;
+    }
+
+    if (raycast->palette) {
+        fprintf(stderr, "ERROR of Raycast_LoadPalette: The textures of the raycaster have already been converted to a palette.\n");
+        Palette_Free(palette);
+        return;
+    }
+
+    raycast->palette = palette;
+    raycast->fog = fog;
+    raycast->index_buffer = Arena_Alloc(raycast->arena, raycast->win_w * raycast->win_h, ARENA_PAGE);
+
+    _convert_textures(raycast);
+    _invalidate(raycast);
+}
+
+void Raycast_LoadLightmap(Raycast_Data* raycast, const Lightmap* lightmap)
+{
+    Raycast_SyncPipeline(raycast);
+
+    if (lightmap && lightmap->map != raycast->map) {
+        fprintf(stderr, "ERROR of Raycast_LoadLightmap: The lightmap was not baked for the map of the raycaster.\n");
+        return;
+    }
+
+    raycast->lightmap = lightmap;
+    _select_kernels(raycast);
+    _invalidate(raycast);
+}
+
+void Raycast_LoadSprites(Raycast_Data* raycast, const SpriteSet* sprites, TexGroup* sprite_tex)
+{
+    Raycast_SyncPipeline(raycast);
+
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_LoadSprites: The sprites are only drawn in buffered modes (textured or AUTO_SPRITE_TEX).\n");
+        if (sprite_tex) TexGroup_Destroy(sprite_tex);
+        return;
+    }
+
+    if (sprite_tex) {
+        if (raycast->sprite_tex) TexGroup_Destroy((TexGroup*)raycast->sprite_tex);
+        raycast->sprite_tex = sprite_tex;
+    }
+
+    if (!raycast->sprite_tex) {
+        fprintf(stderr, "ERROR of Raycast_LoadSprites: No texture is available for the sprites.\n");
+        return;
+    }
+
+    raycast->sprites = sprites;
+    if (raycast->palette) _convert_textures(raycast);
+
+    free(raycast->sprite_views);
+    raycast->sprite_views = malloc(sprites->capacity * sizeof(struct _Raycast_SpriteView));
+
+    if (!raycast->sprite_stamp)
+        raycast->sprite_stamp = Arena_Alloc(raycast->arena, raycast->win_w * raycast->win_h, ARENA_PAGE); // zeroed
+
+    if (!raycast->vis_cells) _alloc_visibility(raycast);
+    _invalidate(raycast);
+}
+
+void Raycast_LoadMaterials(Raycast_Data* raycast, TexGroup* materials)
+{
+    Raycast_SyncPipeline(raycast);
+
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_LoadMaterials: The floor and ceiling are only textured in buffered modes.\n");
+        if (materials) TexGroup_Destroy(materials);
+        return;
+    }
+
+    if (raycast->materials) TexGroup_Destroy((TexGroup*)raycast->materials);
+    raycast->materials = materials;
+
+    if (raycast->palette && materials) _convert_textures(raycast);
+    _select_kernels(raycast);
+    _invalidate(raycast);
+}
+
+SDL_bool Raycast_StartCapture(Raycast_Data* raycast, const char* path, const uint8_t format, const uint16_t fps)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_StartCapture: The colored mode is not cast in a buffer.\n");
+        return SDL_FALSE;
+    }
+
+    if (raycast->capture) Raycast_StopCapture(raycast);
+
+    raycast->capture = Capture_Start(path, format, raycast->win_w, raycast->win_h, fps);
+    return raycast->capture != NULL;
+}
+
+void Raycast_StopCapture(Raycast_Data* raycast)
+{
+    if (!raycast->capture) return;
+
+    Capture_Stop(raycast->capture);
+    raycast->capture = NULL;
+}
+
+void Raycast_SetVisibilityTracking(Raycast_Data* raycast, const SDL_bool enable)
+{
+    Raycast_SyncPipeline(raycast);
+
+    raycast->track_visibility = enable;
+
+    if (enable || raycast->sprites) _alloc_visibility(raycast); // the sprites need the cells but not the faces
+    else {
+        free(raycast->vis_cells);
+        free(raycast->vis_face_bits);
+        free(raycast->vis_faces);
+        raycast->vis_cells = NULL, raycast->vis_face_bits = NULL, raycast->vis_faces = NULL;
+        raycast->vis_face_count = 0;
+    }
+}
+
+SDL_bool Raycast_IsCellVisible(const Raycast_Data* raycast, const int x, const int y)
+{
+    return raycast->vis_cells && _is_cell_marked(raycast, x, y);
+}
+
+SDL_bool Raycast_IsAreaVisible(const Raycast_Data* raycast, int x0, int y0, int x1, int y1)
+{
+    if (!raycast->vis_cells) return SDL_FALSE;
+
+    /* Only the part of the rectangle within the bounds of the marked cells is tested */
+
+    if (x0 < raycast->vis_min_x) x0 = raycast->vis_min_x;
+    if (y0 < raycast->vis_min_y) y0 = raycast->vis_min_y;
+    if (x1 > raycast->vis_max_x) x1 = raycast->vis_max_x;
+    if (y1 > raycast->vis_max_y) y1 = raycast->vis_max_y;
+    if (x0 > x1 || y0 > y1) return SDL_FALSE;
+
+    const uint32_t stride = raycast->map->width + 1;
+
+    for (int y = y0; y <= y1; y++)
+    {
+        const uint32_t first = y * stride + x0, last = y * stride + x1;
+
+        for (uint32_t word = first >> 5; word <= last >> 5; word++)
+        {
+            uint32_t bits = raycast->vis_cells[word];
+            if (word == first >> 5) bits &= UINT32_MAX << (first & 31);
+            if (word == last >> 5) bits &= UINT32_MAX >> (31 - (last & 31));
+            if (bits) return SDL_TRUE;
+        }
+    }
+
+    return SDL_FALSE;
+}
+
+const uint32_t* Raycast_GetVisibleCells(const Raycast_Data* raycast)
+{
+    return raycast->vis_cells;
+}
+
+const Raycast_Face* Raycast_GetVisibleFaces(const Raycast_Data* raycast, uint32_t* count)
+{
+    *count = raycast->vis_faces ? raycast->vis_face_count : 0;
+    return raycast->vis_faces;
+}
+
+void Raycast_SetRenderScale(Raycast_Data* raycast, const float scale)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_SetRenderScale: The colored mode is rendered directly at the window resolution.\n");
+        return;
+    }
+
+    Raycast_SyncPipeline(raycast);
+
+    _apply_render_scale(raycast, scale);
+}
+
+void Raycast_SetInterlace(Raycast_Data* raycast, const uint8_t mode)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_SetInterlace: The colored mode is not cast in a buffer.\n");
+        return;
+    }
+
+    if (mode != INTERLACE_OFF && mode != INTERLACE_COLUMNS && mode != INTERLACE_CHECKERBOARD) {
+        fprintf(stderr, "ERROR of Raycast_SetInterlace: Unknown interlace mode %u.\n", mode);
+        return;
+    }
+
+    Raycast_SyncPipeline(raycast);
+
+    if (mode && !raycast->history)
+        raycast->history = _alloc_history(raycast);
+
+    if (!mode && !raycast->pipeline && raycast->history) // the pipeline keeps the history as front buffer
+        _release_history(raycast);
+
+    raycast->interlace = mode;
+    raycast->history_valid = SDL_FALSE; // the first frame of the mode is cast entirely
+    raycast->field = 0;
+    _invalidate(raycast);
+}
+
+void Raycast_SetZeroCopy(Raycast_Data* raycast, const SDL_bool enable)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_SetZeroCopy: The colored mode is not cast in a buffer.\n");
+        return;
+    }
+
+    raycast->zero_copy = enable;
+}
+
+void Raycast_SetLateLatch(Raycast_Data* raycast, const SDL_bool enable)
+{
+    raycast->late_latch = enable;
+}
+
+void Raycast_SetPipeline(Raycast_Data* raycast, const SDL_bool enable)
+{
+    if (!raycast->buffer) {
+        fprintf(stderr, "ERROR of Raycast_SetPipeline: The colored mode is not cast in a buffer.\n");
+        return;
+    }
+
+    if (enable && !raycast->pipeline)
+    {
+        if (!raycast->history)
+            raycast->history = _alloc_history(raycast);
+
+        struct _Raycast_Pipeline* pipeline = malloc(sizeof(struct _Raycast_Pipeline));
+
+        pipeline->start = SDL_CreateSemaphore(0);
+        pipeline->done = SDL_CreateSemaphore(0);
+        SDL_AtomicSet(&pipeline->quit, 0);
+        pipeline->vis_cells = NULL, pipeline->vis_face_bits = NULL, pipeline->vis_faces = NULL;
+        pipeline->vis_face_count = 0;
+        pipeline->in_flight = SDL_FALSE;
+        pipeline->unshown = SDL_FALSE;
+        pipeline->cost_ms = 0.f;
+
+        raycast->pipeline = pipeline;
+        pipeline->thread = SDL_CreateThread(_pipeline_worker, "raycast_render", pipeline);
+    }
+    else if (!enable && raycast->pipeline)
+    {
+        struct _Raycast_Pipeline* pipeline = raycast->pipeline;
+
+        Raycast_SyncPipeline(raycast);
+
+        SDL_AtomicSet(&pipeline->quit, 1);
+        SDL_SemPost(pipeline->start);
+        SDL_WaitThread(pipeline->thread, NULL);
+
+        SDL_DestroySemaphore(pipeline->start);
+        SDL_DestroySemaphore(pipeline->done);
+        _free_pipeline_visibility(pipeline);
+        free(pipeline);
+        raycast->pipeline = NULL;
+
+        if (!raycast->interlace)
+            _release_history(raycast);
+    }
+
+    _invalidate(raycast); // the render texture may not hold the last frame cast
+}
+
+void Raycast_Invalidate(Raycast_Data* raycast)
+{
+    _invalidate(raycast);
+}
+
+void Raycast_SyncPipeline(Raycast_Data* raycast)
+{
+    struct _Raycast_Pipeline* pipeline = raycast->pipeline;
+    if (!pipeline || !pipeline->in_flight) return;
+
+    SDL_SemWait(pipeline->done);
+    pipeline->in_flight = SDL_FALSE;
+    pipeline->unshown = SDL_TRUE;
+
+    const Raycast_Data* view = &pipeline->view;
+
+    /* The finished frame becomes the front buffer, and the history of the next one */
+
+    raycast->history = view->buffer;
+    raycast->buffer = view->history;
+    raycast->history_pose = _get_pose(view);
+    raycast->history_valid = SDL_TRUE;
+    raycast->field = !view->field;
+    memcpy(raycast->history_depth, view->z_buffer, view->render_w * sizeof(float)); // the next frame casts in the same z_buffer
+
+    /* State left by the casting, for the next frame and the visibility queries */
+
+    raycast->stamp = view->stamp;
+
+    if (view->vis_cells) // the sets of the finished frame go to the raycaster, its own ones are cast in next
+    {
+        pipeline->vis_cells = raycast->vis_cells;
+        pipeline->vis_face_bits = raycast->vis_face_bits;
+        pipeline->vis_faces = raycast->vis_faces;
+        pipeline->vis_face_count = raycast->vis_face_count;
+        pipeline->vis_min_x = raycast->vis_min_x, pipeline->vis_min_y = raycast->vis_min_y;
+        pipeline->vis_max_x = raycast->vis_max_x, pipeline->vis_max_y = raycast->vis_max_y;
+
+        raycast->vis_cells = view->vis_cells;
+        raycast->vis_face_bits = view->vis_face_bits;
+        raycast->vis_faces = view->vis_faces;
+        raycast->vis_face_count = view->vis_face_count;
+        raycast->vis_min_x = view->vis_min_x, raycast->vis_min_y = view->vis_min_y;
+        raycast->vis_max_x = view->vis_max_x, raycast->vis_max_y = view->vis_max_y;
     }
 }
 
+void Raycast_SetScaleGovernor(Raycast_Data* raycast, const float min_scale, const float max_scale, const float target_ms)
+{
+    raycast->scaler.min_scale = fminf(fmaxf(min_scale, 1.f / RENDER_SCALE_STEPS), 1.f);
+    raycast->scaler.max_scale = fminf(fmaxf(max_scale, raycast->scaler.min_scale), 1.f);
+    raycast->scaler.target_ms = target_ms;
+    raycast->scaler.cooldown = 0;
+
+    if (raycast->buffer)
+        _apply_render_scale(raycast, fminf(fmaxf(raycast->render_scale, raycast->scaler.min_scale), raycast->scaler.max_scale));
+}
+
 Raycast_Data* Raycast_Init(
     SDL_Renderer* renderer,
     const uint16_t win_w,
@@ -620,24 +2569,39 @@ Raycast_Data* Raycast_Init(
     const uint16_t player_y,
     uint8_t flags)
 {
+    /* All the memory of the raycaster sized by the window comes from one arena, released at once by Raycast_Free */
+
+    Arena* arena = Arena_Create(_arena_capacity(win_w, win_h), flags & HUGE_PAGES ? ARENA_HUGE_PAGES : 0);
+    if (!arena) return NULL;
+
     /* Autotex generation */
 
     Texture* floor_tex = NULL;
     Texture* ceiling_tex = NULL;
     TexGroup* wall_tex = NULL;
+    TexGroup* sprite_tex = NULL;
 
     const SDL_bool autotex = _autotex_generation(
-        &floor_tex, &ceiling_tex, &wall_tex, flags
+        &floor_tex, &ceiling_tex, &wall_tex, &sprite_tex, flags
     );
 
     /* Raycaster init */
 
-    Raycast_Data* raycast = malloc(sizeof(Raycast_Data));
+    Raycast_Data* raycast = Arena_Alloc(arena, sizeof(Raycast_Data), ARENA_LINE);
+    raycast->arena = arena;
 
     raycast->win_w = win_w;
     raycast->win_h = win_h;
     raycast->h_win_w = win_w / 2;
     raycast->h_win_h = win_h / 2;
+    raycast->render_w = win_w;
+    raycast->render_h = win_h;
+    raycast->h_render_w = win_w / 2;
+    raycast->h_render_h = win_h / 2;
+    raycast->render_scale = 1.f;
+    raycast->stride = win_w;
+    raycast->zero_copy = SDL_FALSE;
+    raycast->scaler = (struct _Raycast_Scaler){ 1.f, 1.f, 0.f, 0.f, 0 };
     raycast->pos_x = 0.f;
     raycast->pos_y = 0.f;
     raycast->pos_z = 0.f;
@@ -650,38 +2614,70 @@ Raycast_Data* Raycast_Init(
     raycast->ctrl = (struct _Raycast_Ctrls){
         SDL_FALSE, SDL_FALSE, SDL_FALSE,
         SDL_FALSE, SDL_FALSE, SDL_FALSE,
-        SDL_FALSE, SDL_FALSE, 0.f, 0.f,
+        0, 0, 0,
         SDL_FALSE, SDL_FALSE
     };
 
+    raycast->redraw = 1; // nothing was cast yet
+    raycast->repaint = SDL_FALSE;
+    raycast->frame_generation = raycast->frame_light_generation = 0;
+    raycast->frame_w = raycast->frame_h = 0;
+
+    raycast->late_latch = SDL_FALSE;
+    raycast->latch_dx = raycast->latch_dy = 0;
+    raycast->shown_time = 0;
+    raycast->latency_ms = 0.f;
+
     raycast->jump_phase = 0.f;
     raycast->crouch_phase = 0.f;
 
-    if (autotex) {
-        raycast->buffer = malloc(win_w * win_h * sizeof(uint32_t));
-        raycast->tex_render = SDL_CreateTexture(renderer,
-            SDL_PIXELFORMAT_ARGB8888,
-            SDL_TEXTUREACCESS_STREAMING,
-            win_w, win_h
-        );
-    } else raycast->buffer = NULL, raycast->tex_render = NULL;
+    raycast->buffer = NULL, raycast->z_buffer = NULL, raycast->tex_render = NULL;
+    raycast->history_depth = NULL;
+    raycast->low_depth = NULL, raycast->low_top = NULL, raycast->low_count = NULL;
+    raycast->pipeline = NULL;
+    raycast->batch_pool = NULL, raycast->batch_threads = 0;
+    if (autotex) _alloc_buffers(renderer, raycast);
+
+    raycast->palette = NULL;
+    raycast->index_buffer = NULL;
+    raycast->fog = 0.f;
+
+    raycast->interlace = INTERLACE_OFF;
+    raycast->field = 0;
+    raycast->history = NULL;
+    raycast->spare_buffer = NULL;
+    raycast->history_valid = SDL_FALSE;
 
     raycast->floor_tex = floor_tex;
     raycast->ceiling_tex = ceiling_tex;
     raycast->wall_tex = wall_tex;
-
+    raycast->materials = NULL;
+    raycast->reload = NULL;
+    raycast->capture = NULL;
+
+    raycast->vis_cells = NULL;
+    raycast->track_visibility = SDL_FALSE;
+    raycast->vis_face_bits = NULL;
+    raycast->vis_faces = NULL;
+    raycast->vis_face_count = 0;
+    raycast->sprites = NULL;
+    raycast->sprite_tex = sprite_tex;
+    raycast->sprite_views = NULL;
+    raycast->sprite_stamp = NULL;
+    raycast->stamp = 0;
+
+    raycast->kernels.cpu = Kernels_Select();
+
+    raycast->map = NULL;
+    raycast->lightmap = NULL;
+    raycast->tex_map = NULL;
     Raycast_LoadMap(raycast, map, player_x, player_y);
 
-    if(!TTF_WasInit()) {
-        if (TTF_Init() < 0) {
-            fprintf(stderr, "Error of TTF_Init: %s\n", TTF_GetError());
-            exit(1);
-        } raycast->ttf_was_init = SDL_FALSE;
-    } else raycast->ttf_was_init = SDL_TRUE;
-
     raycast->main_font = Text_LoadFont(NULL, 16);
     raycast->text_frame_rate = (Text){ 0,0,0,0, NULL };
-    raycast->text_frame_rate.str = malloc(8);
+    raycast->text_frame_rate.str = Arena_Alloc(arena, FPS_TEXT_SIZE, ARENA_LINE);
+    raycast->tex_frame_rate = NULL;
+    raycast->frame_rate = raycast->frame_latency = 0;
 
     /* Misc settings */
 
@@ -718,10 +2714,16 @@ void Raycast_GetEvents(Raycast_Data* raycast, const SDL_Event* event)
 
                 case SDL_SCANCODE_F1:
                     raycast->ctrl.map_display = !raycast->ctrl.map_display;
+                    raycast->repaint = SDL_TRUE;
+                    break;
+
+                case SDL_SCANCODE_F2:
+                    if (raycast->buffer) Raycast_SetInterlace(raycast, (raycast->interlace + 1) % 3);
                     break;
 
                 case SDL_SCANCODE_F3:
                     raycast->ctrl.fps_display = !raycast->ctrl.fps_display;
+                    raycast->repaint = SDL_TRUE;
                     break;
 
                 default:
@@ -755,16 +2757,15 @@ void Raycast_GetEvents(Raycast_Data* raycast, const SDL_Event* event)
 
         case SDL_MOUSEMOTION:
 
-            if (!raycast->ctrl.mouse_mx && abs(event->motion.xrel) > 0) {
-                raycast->ctrl.mouse_dx = event->motion.xrel;
-                raycast->ctrl.mouse_mx = SDL_TRUE;
-            }
+            // every motion of the frame adds up, the camera takes the sum when the frame is cast (see _latch_camera)
+            raycast->ctrl.mouse_dx += event->motion.xrel;
+            raycast->ctrl.mouse_dy += event->motion.yrel;
+            if (!raycast->ctrl.mouse_time) raycast->ctrl.mouse_time = event->motion.timestamp ? event->motion.timestamp : 1;
 
-            if (!raycast->ctrl.mouse_my && abs(event->motion.yrel) > 0) {
-                raycast->ctrl.mouse_dy = event->motion.yrel;
-                raycast->ctrl.mouse_my = SDL_TRUE;
-            }
+            break;
 
+        case SDL_WINDOWEVENT: // exposed, resized, restored... the window may have lost the last frame presented
+            raycast->repaint = SDL_TRUE;
             break;
 
         default:
@@ -774,31 +2775,175 @@ void Raycast_GetEvents(Raycast_Data* raycast, const SDL_Event* event)
 
 void Raycast_Update(Raycast_Data* raycast, const Clock* clock)
 {
-    _update_player_movement(raycast, clock);
-    _update_player_camera(raycast, clock);
+    raycast->prev_pose = _get_pose(raycast);
+
+    _update_player_movement(raycast, clock); // the camera is turned by the mouse at render time, see Raycast_Render
+}
+
+SDL_bool Raycast_NeedsRender(const Raycast_Data* raycast, const Clock* clock)
+{
+    const Raycast_Pose pose = _get_pose(raycast);
+    const Raycast_Pose shown = clock->alpha < 1.f ? _interpolate_pose(&raycast->prev_pose, &pose, clock->alpha) : pose;
+
+    if (raycast->redraw || raycast->repaint || _frame_changed(raycast, &shown))
+        return SDL_TRUE;
+
+    if (raycast->pipeline && (raycast->pipeline->in_flight || raycast->pipeline->unshown)) // the last frame cast is not shown yet
+        return SDL_TRUE;
+
+    return raycast->ctrl.fps_display && raycast->main_font
+        && (clock->fps != raycast->frame_rate || (int)(raycast->latency_ms + .5f) != raycast->frame_latency);
 }
 
-void Raycast_Render(Raycast_Data* raycast, SDL_Renderer* renderer, const Clock* clock)
+SDL_bool Raycast_Render(Raycast_Data* raycast, SDL_Renderer* renderer, const Clock* clock)
 {
-    if (raycast->buffer) {
-        _casting_textured_floor_ceiling(raycast);
-        _casting_walls(NULL, raycast);
-        _render_buffer(renderer, raycast);
+    /* The frame shows the state between the last two ticks, the simulated pose is restored after it.
+       The camera is turned by the mouse as late as possible, right before the frame is cast (see _latch_camera). */
+
+    const Raycast_Pose pose = _get_pose(raycast);
+    const SDL_bool interpolate = clock->alpha < 1.f;
+
+    raycast->latch_dx = raycast->latch_dy = 0;
+
+    if (interpolate) {
+        const Raycast_Pose shown = _interpolate_pose(&raycast->prev_pose, &pose, clock->alpha);
+        _set_pose(raycast, &shown);
+    }
+
+    // the colored mode draws straight to the renderer, it has no frame to draw again
+    const Raycast_Pose shown = _get_pose(raycast);
+    const SDL_bool changed = _frame_changed(raycast, &shown);
+    const SDL_bool cast = changed || raycast->redraw || !raycast->buffer;
+
+    if (raycast->pipeline) {
+        _render_pipelined(renderer, raycast, cast);
+    }
+    else if (raycast->buffer && !cast) {
+        const SDL_Rect area = { 0, 0, raycast->frame_w, raycast->frame_h };
+        SDL_RenderCopy(renderer, raycast->tex_render, &area, NULL);
+    }
+    else if (raycast->buffer) {
+        _swap_reloaded_textures(raycast);
+        raycast->shown_time = _latch_camera(raycast);
+
+        const uint64_t start = SDL_GetPerformanceCounter();
+
+        // the interlaced modes keep the frame in the buffer as history, and the capture reads it, so they still cast it in memory
+        if (!raycast->zero_copy || raycast->interlace || raycast->capture || !_render_zero_copy(renderer, raycast)) {
+            _cast_frame(raycast);
+            if (raycast->capture) Capture_Push(raycast->capture, raycast->buffer, raycast->stride, raycast->render_w, raycast->render_h);
+            _render_buffer(renderer, raycast);
+        }
+
+        if (raycast->interlace) _store_history(raycast);
+        _update_render_scale(raycast, (SDL_GetPerformanceCounter() - start) * 1000.f / SDL_GetPerformanceFrequency());
     }
     else {
+        raycast->shown_time = _latch_camera(raycast);
+
         _render_colored_floor_ceiling(renderer, raycast);
         _casting_walls(renderer, raycast);
     }
 
+    if (cast) _frame_done(raycast, changed);
+    raycast->repaint = SDL_FALSE;
+
     if (raycast->ctrl.map_display)
         _render_map(renderer, raycast);
 
-    if (raycast->ctrl.fps_display)
+    if (raycast->ctrl.fps_display && raycast->main_font)
         _render_fps(renderer, raycast, clock);
+
+    // the orientation is not simulated: the pose restored and the one of the last tick take the turn of the frame
+    if (interpolate) _set_pose(raycast, &pose);
+    _turn_camera(raycast, interpolate ? raycast->latch_dx : 0, interpolate ? raycast->latch_dy : 0);
+
+    raycast->prev_pose.dir_x = raycast->dir_x, raycast->prev_pose.dir_y = raycast->dir_y;
+    raycast->prev_pose.plane_x = raycast->plane_x, raycast->prev_pose.plane_y = raycast->plane_y;
+    raycast->prev_pose.pitch = raycast->pitch;
+
+    return cast;
+}
+
+void Raycast_Present(Raycast_Data* raycast, SDL_Renderer* renderer)
+{
+    SDL_RenderPresent(renderer);
+
+    if (!raycast->shown_time) return; // no input in the frame
+
+    const float latency_ms = (float)(SDL_GetTicks() - raycast->shown_time);
+    raycast->latency_ms = raycast->latency_ms > 0.f ? raycast->latency_ms + .1f * (latency_ms - raycast->latency_ms) : latency_ms;
+    raycast->shown_time = 0;
+}
+
+void Raycast_RenderBatch(
+    Raycast_Data* raycast,
+    const Raycast_Pose* poses,
+    uint32_t** framebuffers,
+    const unsigned count,
+    const uint16_t w,
+    const uint16_t h)
+{
+    struct _Raycast_Batch batch = { raycast, poses, framebuffers, count, w, h, { 0 } };
+
+    if (!raycast->batch_pool) raycast->batch_pool = _create_batch_pool(raycast->batch_threads);
+    struct _Raycast_BatchPool* pool = raycast->batch_pool;
+
+    // the workers are asleep, their scratch only grows
+    if (raycast->palette && pool->scratch_size < (size_t)w * h) {
+        pool->scratch_size = (size_t)w * h;
+        for (unsigned i = 0; i < pool->count; i++) {
+            free(pool->workers[i].scratch);
+            pool->workers[i].scratch = malloc(pool->scratch_size);
+        }
+    }
+
+    /* The calling thread works too, so only the additional workers are woken up */
+
+    unsigned workers = (count + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    if (workers > pool->count) workers = pool->count;
+
+    pool->batch = &batch;
+    for (unsigned i = 1; i < workers; i++) SDL_SemPost(pool->start);
+
+    _batch_worker(&batch, pool->workers[0].scratch);
+
+    for (unsigned i = 1; i < workers; i++) SDL_SemWait(pool->done);
+    pool->batch = NULL;
+}
+
+void Raycast_SetBatchThreads(Raycast_Data* raycast, const unsigned threads)
+{
+    if (raycast->batch_pool) _free_batch_pool(raycast->batch_pool); // started again by the next batch
+    raycast->batch_pool = NULL;
+    raycast->batch_threads = threads;
+}
+
+void Raycast_RenderViews(Raycast_Data** views, const SDL_Rect* viewports, const unsigned count, SDL_Renderer* renderer, const Clock* clock)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        // everything drawn by a raycaster is relative to the viewport, so each one renders as if it was alone in the window
+        SDL_RenderSetViewport(renderer, &viewports[i]);
+        Raycast_Render(views[i], renderer, clock);
+    }
+
+    SDL_RenderSetViewport(renderer, NULL);
 }
 
 void Raycast_Free(Raycast_Data* raycast)
 {
+    if (raycast->pipeline)
+        Raycast_SetPipeline(raycast, SDL_FALSE);
+
+    if (raycast->batch_pool)
+        _free_batch_pool(raycast->batch_pool);
+
+    if (raycast->reload) // waits for the loader thread, the textures decoded are dropped
+        _free_reload(raycast->reload);
+
+    Raycast_StopCapture(raycast);
+
     if (raycast->wall_tex)
         TexGroup_Destroy((TexGroup*)raycast->wall_tex);
 
@@ -808,13 +2953,28 @@ void Raycast_Free(Raycast_Data* raycast)
     if (raycast->floor_tex)
         Texture_Free((Texture*)raycast->floor_tex);
 
-    free(raycast->text_frame_rate.str);
+    if (raycast->materials)
+        TexGroup_Destroy((TexGroup*)raycast->materials);
+
+    if (raycast->sprite_tex)
+        TexGroup_Destroy((TexGroup*)raycast->sprite_tex);
+
+    free(raycast->sprite_views);
+    free(raycast->vis_cells);
+    free(raycast->vis_face_bits);
+    free(raycast->vis_faces);
+
+    if (raycast->main_font)
+        Text_FreeFont(raycast->main_font);
+
+    Map_Destroy((Map*)raycast->map);
 
-    TTF_CloseFont(raycast->main_font);
-    if (!raycast->ttf_was_init) TTF_Quit();
+    if (raycast->palette)
+        Palette_Free((Palette*)raycast->palette);
 
     SDL_DestroyTexture(raycast->tex_render);
-    free(raycast->buffer);
+    if (raycast->tex_map) SDL_DestroyTexture(raycast->tex_map);
+    if (raycast->tex_frame_rate) SDL_DestroyTexture(raycast->tex_frame_rate);
 
-    free(raycast);
+    Arena_Destroy(raycast->arena); // the raycaster itself, its buffers and the frame rate string
 }
\ No newline at end of file
@@ -7,8 +7,14 @@
 #include <SDL2/SDL_ttf.h>
 #include <stdint.h>
 
+#include "arena.h"
+#include "capture.h"
 #include "clock.h"
+#include "kernels.h"
+#include "light.h"
 #include "map.h"
+#include "palette.h"
+#include "sprite.h"
 #include "textures.h"
 #include "text.h"
 
@@ -17,26 +23,100 @@
 #define AUTO_FLOOR_TEX          0x02
 #define AUTO_CEILING_TEX        0x04
 #define AUTO_FULL_TEX           0x08
+#define AUTO_SPRITE_TEX         0x10
+#define HUGE_PAGES              0x20    // backs the framebuffers of the raycaster with huge pages, where the system has them
+
+#define FACE_WEST               0x00    // faces of a wall cell, north is toward y = 0
+#define FACE_EAST               0x01
+#define FACE_NORTH              0x02
+#define FACE_SOUTH              0x03
+
+#define INTERLACE_OFF           0x00
+#define INTERLACE_COLUMNS       0x01
+#define INTERLACE_CHECKERBOARD  0x02
+
+typedef struct {
+    float pos_x, pos_y;
+    float pos_z, pitch;
+    float dir_x, dir_y;
+    float plane_x, plane_y;
+} Raycast_Pose;
 
 struct _Raycast_Ctrls {
     SDL_bool up, down;
     SDL_bool left, right;
     SDL_bool jump, crouch;
-    SDL_bool mouse_mx, mouse_my;
-    int8_t mouse_dx, mouse_dy;
+    int32_t mouse_dx, mouse_dy;     // relative motion received since the camera last took it
+    uint32_t mouse_time;            // SDL ticks of the oldest of these motions, 0 if none
     SDL_bool map_display;
     SDL_bool fps_display;
 }; 
 
+typedef struct {
+    uint16_t x, y;              // wall cell
+    uint8_t face;               // FACE_WEST || FACE_EAST || FACE_NORTH || FACE_SOUTH
+} Raycast_Face;
+
+struct _Raycast_SpriteView {
+    float depth, transform_x;   // position of the sprite in camera space
+    uint32_t id;
+};
+
+struct _Raycast_Pipeline;
+struct _Raycast_Reload;
+
+struct _Raycast_Kernels {       // inner loops of the 32 bits mode specialized for the textures and the lighting
+    const Kernels* cpu;                                             // vectorized ones, chosen at Raycast_Init (see Kernels_Select)
+    _Raycast_RowKernel floor[2], ceiling[2], material[2], flat[2]; // without and with spans of cells
+    _Raycast_ColumnKernel wall[2];                                  // by side of the wall
+};
+
+struct _Raycast_Scaler {
+    float min_scale, max_scale;
+    float target_ms;            // render budget per frame, 0 disables the governor
+    float cost_ms;              // smoothed render cost of the last frames
+    uint16_t cooldown;          // frames to wait before the next adjustment
+};
+
 // raycast -> pos_z: vertical camera strafing up/down, for jumping/crouching. 0 means standard height. Expressed in screen pixels a wall at distance 1 shifts.
 // raycast -> pitch: looking up/down, expressed in screen pixels the horizon shifts.
-// raycast -> mouse_mX|Y: whether the mouse moves on an X or Y axis.
+// raycast -> ctrl.mouse_dX|Y: mouse motion summed since the last frame, it turns the camera right before the frame is
+//            cast rather than at the simulation ticks: the orientation is not interpolated. With late_latch the motion
+//            still queued is taken from SDL at that moment too (the caller doesn't get these events).
+// raycast -> latency_ms: average time from a mouse motion to the present of the first frame showing it, measured by
+//            Raycast_Present (shown with the FPS), 0 until measured.
+// raycast -> render_w|h: internal resolution of the buffer (textured mode), upscaled to the window by SDL_RenderCopy.
+// raycast -> render_scale: ratio between the internal resolution and the window, moved by the governor if it is enabled.
+// raycast -> interlace: casts half of the pixels each frame (alternate columns or checkerboard), the other half is
+//            reprojected from the previous frame (history): by whole columns when the camera only rotated, else the pixels
+//            whose cast neighbours differ from the depth of their column. The others, and the pixels out of the history or
+//            hidden in it, are interpolated from their neighbours.
+// raycast -> pipeline: a render thread casts the next frame in buffer while the last one (history) is uploaded,
+//            at the cost of one frame of latency. The map, sprites and lightmap are read by the render thread between
+//            two calls of Raycast_Render: call Raycast_SyncPipeline before changing them. The visibility sets are double
+//            buffered: the render thread marks its own ones, swapped with those of the raycaster when the frame is done,
+//            so the queries can run meanwhile and tell what the last frame finished showed.
+// raycast -> palette: palettized mode, the textures hold 8 bits indices and the frame is cast in index_buffer, shaded
+//            by the colormaps (fog levels per map unit of distance), then expanded to 32 bits in buffer before upload.
+// raycast -> reload: the textures decoded by Raycast_ReloadTex are swapped in by the first Raycast_Render after
+//            they are ready (all of them or none if one failed), the previous ones are released then.
+// raycast -> redraw: Raycast_Render casts a frame only if something it shows changed since the last one (the pose
+//            shown, the map or lightmap generation, the internal resolution, the textures and settings given to the
+//            raycaster), otherwise the frame cast last is drawn again without casting nor upload. The changes it can't
+//            see (sprites or lights moved, map->data written directly) need Raycast_Invalidate. Raycast_NeedsRender
+//            also tells when the overlays or the window need it, to skip the whole frame when it would look the same.
+// raycast -> map: can be edited with Map_SetCell and Map_FillRect (after Raycast_SyncPipeline), the minimap only
+//            uploads the edited cells. The lightmap is not updated by the raycaster, see Lightmap_Sync.
 
 typedef struct {
 
     uint16_t win_w, win_h;
     uint16_t h_win_w, h_win_h;
 
+    uint16_t render_w, render_h;
+    uint16_t h_render_w, h_render_h;
+    float render_scale;
+
     float pos_x, pos_y;
     float pos_z, pitch; 
     float dir_x, dir_y;
@@ -44,22 +124,86 @@ typedef struct {
 
     struct _Raycast_Ctrls ctrl;
     float jump_phase, crouch_phase;
+    Raycast_Pose prev_pose;             // pose before the last simulation tick, interpolated with clock->alpha at render time
+    SDL_bool late_latch;                // see Raycast_SetLateLatch
+    int32_t latch_dx, latch_dy;         // mouse motion taken by the frame being rendered
+    uint32_t shown_time;                // SDL ticks of the oldest input shown by the frame uploaded, 0 if none
+    float latency_ms;
 
     uint32_t* buffer;
+    uint32_t stride;                    // pixels between two rows of buffer, the pitch of the render texture in zero-copy mode
+    SDL_bool zero_copy;
+    Capture* capture;                   // records the frames cast, see Raycast_StartCapture
     SDL_Texture* tex_render;
+    struct _Raycast_Scaler scaler;
+
+    const Palette* palette;
+    uint8_t* index_buffer;
+    float fog;
+
+    uint8_t interlace, field;
+    uint32_t* history;
+    uint32_t* spare_buffer;             // block of the history kept in the arena while neither interlace nor pipeline needs it
+    Raycast_Pose history_pose;
+    float* history_depth;               // z_buffer of the history, to tell the pixels hidden in it when reprojecting
+    SDL_bool history_valid;
+
+    uint8_t redraw;                     // frames to cast even if nothing changed, see Raycast_Invalidate
+    SDL_bool repaint;                   // the window needs the frame again (overlay toggled, window event)
+    Raycast_Pose frame_pose;            // what the frame cast last was cast with
+    uint32_t frame_generation, frame_light_generation;
+    uint16_t frame_w, frame_h;
+
+    struct _Raycast_Pipeline* pipeline;
+    struct _Raycast_BatchPool* batch_pool;  // workers of Raycast_RenderBatch, started by the first batch
+    unsigned batch_threads;
+
+    float* z_buffer;                    // perpendicular distance of the wall cast in each column
+    float* low_depth;                   // per column, distance of each low wall drawn front to back (see Map_SetHeight)
+    int16_t* low_top;                   // and the first row covered once it is drawn
+    uint8_t* low_count;                 // number of low walls kept in each column
+    uint32_t* vis_cells;                // bitset of the map cells crossed by the rays this frame
+    uint16_t vis_min_x, vis_min_y;      // bounds of the cells marked, the only ones cleared for the next frame
+    uint16_t vis_max_x, vis_max_y;
+
+    SDL_bool track_visibility;
+    uint32_t* vis_face_bits;            // 4 bits per map cell, to list each face only once
+    Raycast_Face* vis_faces;            // wall faces hit by the rays this frame, each one once (sized for every face of the map)
+    uint32_t vis_face_count;
+
+    const SpriteSet* sprites;
+    const TexGroup* sprite_tex;
+    struct _Raycast_SpriteView* sprite_views;
+    uint8_t* sprite_stamp;              // per pixel, stamp of the last frame where a sprite was drawn on it
+    uint8_t stamp;
 
     const Texture* floor_tex;
     const Texture* ceiling_tex;
     const TexGroup* wall_tex;
+    const TexGroup* materials;          // floor and ceiling textures of the cells, see Map_SetMaterial
+    struct _Raycast_Kernels kernels;
+    struct _Raycast_Reload* reload;     // textures being decoded by Raycast_ReloadTex
 
     const Map* map;
+    const Lightmap* lightmap;
+    SDL_Texture* tex_map;               // cached minimap, see Map_GetDirty
+    uint32_t map_generation;
 
-    SDL_bool ttf_was_init;
     TTF_Font* main_font;
     Text text_frame_rate;
+    SDL_Texture* tex_frame_rate;        // rendered again only when the frame rate or the latency change
+    int frame_rate, frame_latency;
+
+    Arena* arena;                       // the raycaster and its buffers, see Raycast_Init
 
 } Raycast_Data;
 
+// The raycaster keeps a reference on its map (see Map_Retain), and takes over the reference of the textures given
+// to Raycast_LoadTex: to share textures between several raycasters, pass them with Texture_Retain/TexGroup_Retain.
+// A palettized raycaster indexes a shared texture in a copy of its own, see Palette_ConvertTexture.
+// The raycaster and its buffers sized by the window live in one arena (see arena.h) released by Raycast_Free,
+// Raycast_Init returns NULL if it can't be reserved. The textures stay apart, being shared and reference counted.
+
 void Raycast_LoadMap(
     Raycast_Data* raycast,
     const Map* map,
@@ -85,22 +229,166 @@ Raycast_Data* Raycast_Init(
     uint8_t flags
 );
 
+SDL_bool Raycast_ReloadTex( // only for textured mode, decodes the textures on a background thread, SDL_FALSE if a reload is pending
+    Raycast_Data* raycast,
+    const char* floor_path,     // NULL keeps the current texture
+    const char* ceiling_path,
+    const char** wall_paths,    // NULL keeps the current ones, else at least one per kind of wall of the map
+    const unsigned wall_num
+);
+
+void Raycast_LoadPalette( // only for textured mode, converts the textures of the raycaster (and the next ones), takes over the palette reference
+    Raycast_Data* raycast,
+    Palette* palette,
+    const float fog
+);
+
+void Raycast_LoadLightmap( // the lightmap must be baked for the map of the raycaster and outlive it, NULL disables the lighting
+    Raycast_Data* raycast,
+    const Lightmap* lightmap
+);
+
+void Raycast_LoadSprites( // the set must outlive the raycaster, the texture reference is taken over (NULL keeps AUTO_SPRITE_TEX)
+    Raycast_Data* raycast,
+    const SpriteSet* sprites,
+    TexGroup* sprite_tex
+);
+
+void Raycast_LoadMaterials( // only for buffered modes, the texture reference is taken over (NULL removes the materials)
+    Raycast_Data* raycast,
+    TexGroup* materials
+);
+
+// Visibility tracking: each frame the raycaster outputs the set of map cells crossed by its rays (free cells and
+// the walls that stopped them) and the list of wall faces hit, as a by-product of the wall casting. Anything in a
+// cell out of this set is hidden by the walls or out of the view. With INTERLACE_COLUMNS the set comes from the
+// half of the rays cast in the frame. The set and list returned stay valid until the next Raycast_Render.
+
+void Raycast_SetVisibilityTracking(
+    Raycast_Data* raycast,
+    const SDL_bool enable
+);
+
+SDL_bool Raycast_IsCellVisible(
+    const Raycast_Data* raycast,
+    const int x,
+    const int y
+);
+
+SDL_bool Raycast_IsAreaVisible( // whether any cell of the rectangle (bounds included) is visible
+    const Raycast_Data* raycast,
+    int x0, int y0,
+    int x1, int y1
+);
+
+const uint32_t* Raycast_GetVisibleCells( // bitset of the cells, the bit of the cell (x, y) is y * (map->width + 1) + x
+    const Raycast_Data* raycast
+);
+
+const Raycast_Face* Raycast_GetVisibleFaces(
+    const Raycast_Data* raycast,
+    uint32_t* count
+);
+
+void Raycast_SetRenderScale( // only for textured mode, the scale is clamped to ]0, 1]
+    Raycast_Data* raycast,
+    const float scale
+);
+
+void Raycast_SetInterlace( // only for textured mode, INTERLACE_OFF || INTERLACE_COLUMNS || INTERLACE_CHECKERBOARD
+    Raycast_Data* raycast,
+    const uint8_t mode
+);
+
+void Raycast_SetZeroCopy( // only for textured mode, casts in the memory of the locked render texture instead of copying the buffer in it (not with interlace, pipeline nor capture)
+    Raycast_Data* raycast,
+    const SDL_bool enable
+);
+
+void Raycast_SetLateLatch( // pumps the SDL events right before casting so the camera takes the mouse motion received meanwhile
+    Raycast_Data* raycast,
+    const SDL_bool enable
+);
+
+void Raycast_SetPipeline( // only for textured mode
+    Raycast_Data* raycast,
+    const SDL_bool enable
+);
+
+SDL_bool Raycast_StartCapture( // only for textured mode, records each frame cast (without the minimap and the FPS) at the size of the window
+    Raycast_Data* raycast,
+    const char* path,
+    const uint8_t format,       // CAPTURE_RAW || CAPTURE_Y4M
+    const uint16_t fps          // frame rate written in the Y4M header, the frames are recorded as they are rendered
+);
+
+void Raycast_StopCapture( // writes the frames still in the ring and closes the file
+    Raycast_Data* raycast
+);
+
+void Raycast_SyncPipeline( // waits for the frame being cast by the render thread, if any
+    Raycast_Data* raycast
+);
+
+void Raycast_SetScaleGovernor( // adjusts the render scale between min and max to keep the render cost under target_ms (0 to disable)
+    Raycast_Data* raycast,
+    const float min_scale,
+    const float max_scale,
+    const float target_ms
+);
+
 void Raycast_GetEvents(
     Raycast_Data* raycast,
     const SDL_Event* event
 );
 
-void Raycast_Update(
+void Raycast_Update( // one simulation tick of clock->step seconds, see Clock_Tick
     Raycast_Data* raycast,
     const Clock* clock
 );
 
-void Raycast_Render(
+SDL_bool Raycast_NeedsRender( // whether Raycast_Render would show something new, if not the caller can skip the frame and the present
+    const Raycast_Data* raycast,
+    const Clock* clock
+);
+
+SDL_bool Raycast_Render( // SDL_TRUE if a frame was cast, SDL_FALSE if the last one was drawn again (see raycast -> redraw)
     Raycast_Data* raycast,
     SDL_Renderer* renderer,
     const Clock* clock
 );
 
+void Raycast_Invalidate( // the next frame is cast even if nothing the raycaster sees changed
+    Raycast_Data* raycast
+);
+
+void Raycast_Present( // SDL_RenderPresent, then measures the input latency of the frame (see raycast -> latency_ms)
+    Raycast_Data* raycast,
+    SDL_Renderer* renderer
+);
+
+void Raycast_RenderBatch( // renders each pose in its own w*h ARGB framebuffer (caller-owned), spread over the CPU cores, one batch at a time per raycaster
+    Raycast_Data* raycast,          // provides the shared map and textures, and the workers kept from a batch to the next
+    const Raycast_Pose* poses,      // pitch and pos_z are expressed in pixels of the framebuffers
+    uint32_t** framebuffers,
+    const unsigned count,
+    const uint16_t w,
+    const uint16_t h
+);
+
+void Raycast_SetBatchThreads( // workers of Raycast_RenderBatch, the calling thread included, 0 for one per CPU core (default)
+    Raycast_Data* raycast,
+    const unsigned threads
+);
+
+void Raycast_RenderViews( // renders several raycasters in the viewports of the same window, each one sized like its viewport
+    Raycast_Data** views,
+    const SDL_Rect* viewports,
+    const unsigned count,
+    SDL_Renderer* renderer,
+    const Clock* clock
+);
+
 void Raycast_Free(
     Raycast_Data* raycast
 );
@@ -0,0 +1,99 @@
+#include "sprite.h"
+
+#include <SDL2/SDL_stdinc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "map.h"
+
+SpriteSet* Sprite_CreateSet(const Map* map, const uint32_t capacity)
+{
+    SpriteSet* set = malloc(sizeof(SpriteSet));
+
+    set->sprites = malloc(sizeof(Sprite) * capacity);
+    set->count = 0;
+    set->capacity = capacity;
+
+    /* The grid covers the whole map, cells are 0..width and 0..height included */
+
+    set->buckets_w = (map->width >> SPRITE_BUCKET_SHIFT) + 1;
+    set->buckets_h = (map->height >> SPRITE_BUCKET_SHIFT) + 1;
+
+    set->bucket_start = calloc(set->buckets_w * set->buckets_h + 1, sizeof(uint32_t));
+    set->bucket_items = malloc(sizeof(uint32_t) * capacity);
+    set->dirty = SDL_FALSE;
+
+    return set;
+}
+
+int32_t Sprite_Add(SpriteSet* set, const float x, const float y, const uint16_t tex)
+{
+    if (set->count == set->capacity) return -1;
+
+    set->sprites[set->count] = (Sprite){ x, y, tex };
+    set->dirty = SDL_TRUE;
+
+    return set->count++;
+}
+
+void Sprite_Move(SpriteSet* set, const uint32_t id, const float x, const float y)
+{
+    set->sprites[id].x = x;
+    set->sprites[id].y = y;
+    set->dirty = SDL_TRUE;
+}
+
+void Sprite_Remove(SpriteSet* set, const uint32_t id)
+{
+    set->sprites[id] = set->sprites[--set->count];
+    set->dirty = SDL_TRUE;
+}
+
+uint32_t _sprite_bucket(const SpriteSet* set, const Sprite* sprite)
+{
+    int bx = (int)sprite->x >> SPRITE_BUCKET_SHIFT;
+    int by = (int)sprite->y >> SPRITE_BUCKET_SHIFT;
+
+    // sprites out of the map are kept in the border buckets
+    if (bx < 0) bx = 0; else if (bx >= set->buckets_w) bx = set->buckets_w - 1;
+    if (by < 0) by = 0; else if (by >= set->buckets_h) by = set->buckets_h - 1;
+
+    return by * set->buckets_w + bx;
+}
+
+void Sprite_Commit(SpriteSet* set)
+{
+    if (!set->dirty) return;
+
+    const uint32_t bucket_num = set->buckets_w * set->buckets_h;
+    uint32_t* start = set->bucket_start;
+
+    /* Counting sort: count, prefix sum, then place each sprite */
+
+    memset(start, 0, sizeof(uint32_t) * (bucket_num + 1));
+
+    for (uint32_t i = 0; i < set->count; i++)
+        start[_sprite_bucket(set, &set->sprites[i]) + 1]++;
+
+    for (uint32_t b = 0; b < bucket_num; b++)
+        start[b + 1] += start[b];
+
+    for (uint32_t i = 0; i < set->count; i++)
+        set->bucket_items[start[_sprite_bucket(set, &set->sprites[i])]++] = i;
+
+    // placing shifted every start to the end of its bucket, shift them back
+    for (uint32_t b = bucket_num; b > 0; b--)
+        start[b] = start[b - 1];
+    start[0] = 0;
+
+    set->dirty = SDL_FALSE;
+}
+
+void Sprite_DestroySet(SpriteSet* set)
+{
+    free(set->bucket_items);
+    free(set->bucket_start);
+    free(set->sprites);
+    free(set);
+}
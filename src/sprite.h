@@ -0,0 +1,62 @@
+#ifndef _SPRITE_H_
+#define _SPRITE_H_
+
+#include <SDL2/SDL_stdinc.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#define SPRITE_BUCKET_SHIFT 2   // sprites are bucketed in a uniform grid of 4x4 map cells
+
+typedef struct {
+    float x, y;
+    uint16_t tex;               // index in the sprite TexGroup, black (0) texels are transparent
+} Sprite;
+
+// The capacity of a set is fixed at creation, so the sprites never move in memory.
+// The buckets are rebuilt with a counting sort by Sprite_Commit, on the thread editing the set: the raycasters only
+// read it. Until the changes are committed, the raycasters test every sprite instead of the buckets in view.
+
+typedef struct {
+    Sprite* sprites;
+    uint32_t count, capacity;
+
+    uint16_t buckets_w, buckets_h;
+    uint32_t* bucket_start;     // first entry of each bucket in bucket_items, one more entry for the end
+    uint32_t* bucket_items;     // sprite indices ordered by bucket
+    SDL_bool dirty;
+} SpriteSet;
+
+SpriteSet* Sprite_CreateSet(
+    const Map* map,
+    const uint32_t capacity
+);
+
+int32_t Sprite_Add( // returns the index of the sprite, or -1 if the set is full
+    SpriteSet* set,
+    const float x,
+    const float y,
+    const uint16_t tex
+);
+
+void Sprite_Move(
+    SpriteSet* set,
+    const uint32_t id,
+    const float x,
+    const float y
+);
+
+void Sprite_Remove( // the last sprite of the set takes the index of the removed one
+    SpriteSet* set,
+    const uint32_t id
+);
+
+void Sprite_Commit( // after the changes of a tick, before the set is rendered again
+    SpriteSet* set
+);
+
+void Sprite_DestroySet(
+    SpriteSet* set
+);
+
+#endif
@@ -1,6 +1,10 @@
 #include "text.h"
 
 #include <SDL2/SDL_ttf.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef __linux__
 # define FONT_PATH "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
@@ -10,20 +14,107 @@
 # define FONT_PATH "C:\\Windows\\Fonts\\Arial.ttf"
 #endif
 
+struct _Text_SharedFont {
+    char* path;
+    int size;
+    unsigned refs;                  // like the list, only read and written with fonts_mutex locked
+    TTF_Font* font;
+    struct _Text_SharedFont* next;
+};
+
+static struct _Text_SharedFont* shared_fonts = NULL;
+static SDL_bool ttf_init_here = SDL_FALSE; // SDL_ttf is shut down with the last font only if it was initialized here
+static SDL_mutex* fonts_mutex = NULL;       // guards the shared fonts and the initialization of SDL_ttf
+
+SDL_mutex* _fonts_mutex(void) // created by the first caller and kept until the exit, there is no init function to do it
+{
+    SDL_mutex* mutex = SDL_AtomicGetPtr((void**)&fonts_mutex);
+    if (mutex) return mutex;
+
+    mutex = SDL_CreateMutex();
+
+    if (!SDL_AtomicCASPtr((void**)&fonts_mutex, NULL, mutex)) { // another thread created it first
+        SDL_DestroyMutex(mutex);
+        mutex = SDL_AtomicGetPtr((void**)&fonts_mutex);
+    }
+
+    return mutex;
+}
+
 TTF_Font* Text_LoadFont(const char* path, const int size)
 {
     if (!path || (path && !path[0])) path = FONT_PATH;
 
+    SDL_mutex* mutex = _fonts_mutex();
+    SDL_LockMutex(mutex);
+
+    for (struct _Text_SharedFont* shared = shared_fonts; shared; shared = shared->next) {
+        if (shared->size == size && !strcmp(shared->path, path)) {
+            shared->refs++;
+            SDL_UnlockMutex(mutex);
+            return shared->font;
+        }
+    }
+
+    if (!TTF_WasInit()) {
+        if (TTF_Init() < 0) {
+            fprintf(stderr, "Error of TTF_Init: %s\n", TTF_GetError());
+            SDL_UnlockMutex(mutex);
+            return NULL;
+        } ttf_init_here = SDL_TRUE;
+    }
+
     TTF_Font* font = TTF_OpenFont(path, size);
 
     if (!font) {
         fprintf(stderr, "ERROR: Counldn't load font. %s\n", TTF_GetError());
+        if (!shared_fonts && ttf_init_here) TTF_Quit(), ttf_init_here = SDL_FALSE;
+        SDL_UnlockMutex(mutex);
         return NULL;
     }
 
+    struct _Text_SharedFont* shared = malloc(sizeof(struct _Text_SharedFont));
+    shared->path = malloc(strlen(path) + 1);
+    strcpy(shared->path, path);
+    shared->size = size;
+    shared->refs = 1;
+    shared->font = font;
+    shared->next = shared_fonts;
+    shared_fonts = shared;
+
+    SDL_UnlockMutex(mutex);
     return font;
 }
 
+void Text_FreeFont(TTF_Font* font)
+{
+    SDL_mutex* mutex = _fonts_mutex();
+    SDL_LockMutex(mutex);
+
+    for (struct _Text_SharedFont** link = &shared_fonts; *link; link = &(*link)->next)
+    {
+        struct _Text_SharedFont* shared = *link;
+        if (shared->font != font) continue;
+
+        if (--shared->refs > 0) {
+            SDL_UnlockMutex(mutex);
+            return;
+        }
+
+        *link = shared->next;
+        TTF_CloseFont(shared->font);
+        free(shared->path);
+        free(shared);
+
+        if (!shared_fonts && ttf_init_here) TTF_Quit(), ttf_init_here = SDL_FALSE;
+        SDL_UnlockMutex(mutex);
+        return;
+    }
+
+    TTF_CloseFont(font); // not loaded with Text_LoadFont
+    SDL_UnlockMutex(mutex);
+}
+
 void Text_Render(SDL_Renderer* renderer, const Text text, TTF_Font* font, const SDL_Color color, const SDL_bool adjust_size)
 {
     SDL_Surface* surface = TTF_RenderText_Blended(font, text.str, color);
@@ -41,4 +132,20 @@ void Text_Render(SDL_Renderer* renderer, const Text text, TTF_Font* font, const
 
     SDL_DestroyTexture(texture);
     SDL_FreeSurface(surface);
-}
\ No newline at end of file
+}
+
+SDL_Texture* Text_Bake(SDL_Renderer* renderer, Text* text, TTF_Font* font, const SDL_Color color)
+{
+    SDL_Surface* surface = TTF_RenderText_Blended(font, text->str, color);
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+
+    if (color.a != 255)
+        SDL_SetTextureAlphaMod(texture, color.a);
+
+    int w, h;
+    TTF_SizeText(font, text->str, &w, &h);
+    text->w = w, text->h = h;
+
+    return texture;
+}
@@ -10,11 +10,18 @@ typedef struct {
     char* str;
 } Text;
 
+// Fonts can be loaded and freed from any thread. A font itself is not thread safe (SDL_ttf): two threads
+// sharing it must not render with it at the same time.
+
 TTF_Font* Text_LoadFont( // written for fast font loading, the path argument can be NULL
-    const char* path,
+    const char* path,       // fonts are shared, loading the same path and size again returns the same font with one more reference
     const int size
 );
 
+void Text_FreeFont( // releases one reference, the font is closed with the last one
+    TTF_Font* font
+);
+
 void Text_Render(
     SDL_Renderer* renderer,
     const Text text,
@@ -23,4 +30,11 @@ void Text_Render(
     const SDL_bool adjust_size
 );
 
+SDL_Texture* Text_Bake( // renders the text once in a texture to draw with SDL_RenderCopy, for a text that rarely changes
+    SDL_Renderer* renderer,
+    Text* text,             // its size is set to the size of the rendered string
+    TTF_Font* font,
+    const SDL_Color color
+);
+
 #endif
\ No newline at end of file
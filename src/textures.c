@@ -9,19 +9,20 @@
 #include <string.h>
 #include <time.h>
 
-Texture* Texture_Load(const char* path)
+Texture* Texture_TryLoad(const char* path)
 {
-    Texture* tex = malloc(sizeof(Texture));
-
     SDL_Surface* tex_surface_tmp = IMG_Load(path);
 
     if (!tex_surface_tmp) {
         fprintf(stderr, "Error of IMG_Load: %s\n", IMG_GetError());
-        exit(1);
+        return NULL;
     }
 
+    Texture* tex = malloc(sizeof(Texture));
+
     SDL_PixelFormat* format = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888);
     SDL_Surface* tex_surface = SDL_ConvertSurface(tex_surface_tmp, format, 0);
+    SDL_FreeFormat(format);
     SDL_FreeSurface(tex_surface_tmp);
 
     const size_t tex_size = sizeof(Pixel) * tex_surface->w * tex_surface->h;
@@ -31,23 +32,45 @@ Texture* Texture_Load(const char* path)
 
     tex->w = tex_surface->w;
     tex->h = tex_surface->h;
+    tex->indices = NULL;
+    tex->palette_id = 0;
+    SDL_AtomicSet(&tex->refs, 1);
 
     SDL_FreeSurface(tex_surface);
 
     return tex;
 }
 
+Texture* Texture_Load(const char* path)
+{
+    Texture* tex = Texture_TryLoad(path);
+    if (!tex) exit(1);
+    return tex;
+}
+
+Texture* Texture_Retain(Texture* tex)
+{
+    SDL_AtomicIncRef(&tex->refs);
+    return tex;
+}
+
 void Texture_Free(Texture* tex)
 {
+    if (!SDL_AtomicDecRef(&tex->refs)) return;
+
     free(tex->pixels);
+    free(tex->indices);
     free(tex);
 }
 
-TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num)
+TexGroup* TexGroup_TryLoad(const char** paths, const unsigned tex_num)
 {
         TexGroup* tex_grp = malloc(sizeof(TexGroup));
-        tex_grp->pixels = malloc(sizeof(*tex_grp->pixels) * tex_num);
+        tex_grp->pixels = calloc(tex_num, sizeof(*tex_grp->pixels)); // the textures not loaded yet are NULL if one fails
+        tex_grp->indices = NULL;
+        tex_grp->palette_id = 0;
         tex_grp->length = tex_num;
+        SDL_AtomicSet(&tex_grp->refs, 1);
 
         uint16_t tex_w[2], tex_h[2];
         size_t tex_size;
@@ -58,11 +81,13 @@ TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num)
 
             if (!tex_surface_tmp) {
                 fprintf(stderr, "%s\n", IMG_GetError());
-                exit(1);
+                TexGroup_Destroy(tex_grp);
+                return NULL;
             }
 
             SDL_PixelFormat* format = SDL_AllocFormat(SDL_PIXELFORMAT_RGB888);
             SDL_Surface* tex_surface = SDL_ConvertSurface(tex_surface_tmp, format, 0);
+            SDL_FreeFormat(format);
             SDL_FreeSurface(tex_surface_tmp);
 
             tex_w[0] = tex_surface->w, tex_h[0] = tex_surface->h;
@@ -71,7 +96,9 @@ TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num)
                 tex_size = sizeof(Pixel) * tex_w[0] * tex_h[0];
             } else if (tex_w[0] != tex_w[1] || tex_h[0] != tex_h[1]) {
                 fprintf(stderr, "ERROR of Tex_Array_New: The dimensions of \"%s\" are not identical to the previous textures.\n", paths[i]);
-                exit(1);
+                SDL_FreeSurface(tex_surface);
+                TexGroup_Destroy(tex_grp);
+                return NULL;
             }
 
             tex_grp->pixels[i] = malloc(tex_size);
@@ -82,17 +109,35 @@ TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num)
             SDL_FreeSurface(tex_surface);
         }
 
-        tex_grp->w = tex_w[0];
-        tex_grp->h = tex_h[0];
+        tex_grp->w = tex_num ? tex_w[0] : 0;
+        tex_grp->h = tex_num ? tex_h[0] : 0;
 
     return tex_grp;
 }
 
+TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num)
+{
+    TexGroup* tex_grp = TexGroup_TryLoad(paths, tex_num);
+    if (!tex_grp) exit(1);
+    return tex_grp;
+}
+
+TexGroup* TexGroup_Retain(TexGroup* tex_grp)
+{
+    SDL_AtomicIncRef(&tex_grp->refs);
+    return tex_grp;
+}
+
 void TexGroup_Destroy(TexGroup* tex_grp)
 {
-    for (int i = 0; i < tex_grp->length; i++)
-        free(tex_grp->pixels[i]);
+    if (!SDL_AtomicDecRef(&tex_grp->refs)) return;
+
+    for (int i = 0; i < tex_grp->length; i++) {
+        if (tex_grp->pixels) free(tex_grp->pixels[i]);
+        if (tex_grp->indices) free(tex_grp->indices[i]);
+    }
 
     free(tex_grp->pixels);
+    free(tex_grp->indices);
     free(tex_grp);
 }
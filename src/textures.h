@@ -1,25 +1,41 @@
 #ifndef _TEXTURES_H_
 #define _TEXTURES_H_
 
+#include <SDL2/SDL_atomic.h>
 #include <stdint.h>
 
 typedef uint32_t Pixel;
 
+// Textures are reference counted so that several raycasters can share them,
+// they are created with one reference and freed when the last one is released.
+// The 8 bits indices of a palette (see palette.h) are kept beside the pixels, keyed by the id of the palette.
+// The copy indexed for a raycaster while the texture was shared only has the indices, pixels is NULL.
+
 typedef struct {
     uint16_t w, h;
     Pixel* pixels;
+    uint8_t* indices;
+    uint32_t palette_id;    // of the indices, 0 if there are none
+    SDL_atomic_t refs;
 } Texture;
 
 typedef struct {
     uint16_t length;
     uint16_t w, h;
     Pixel** pixels;
+    uint8_t** indices;
+    uint32_t palette_id;
+    SDL_atomic_t refs;
 } TexGroup;
 
-Texture* Texture_Load(const char* path);
-void Texture_Free(Texture* tex);
+Texture* Texture_Load(const char* path); // exits if the image can't be loaded
+Texture* Texture_TryLoad(const char* path); // NULL if the image can't be loaded, can be called from any thread
+Texture* Texture_Retain(Texture* tex);
+void Texture_Free(Texture* tex); // releases one reference
 
-TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num);
-void TexGroup_Destroy(TexGroup* tex_grp);
+TexGroup* TexGroup_Load(const char** paths, const unsigned tex_num); // exits if an image can't be loaded
+TexGroup* TexGroup_TryLoad(const char** paths, const unsigned tex_num); // NULL if an image can't be loaded or has another size
+TexGroup* TexGroup_Retain(TexGroup* tex_grp);
+void TexGroup_Destroy(TexGroup* tex_grp); // releases one reference
 
 #endif
\ No newline at end of file